@@ -18,7 +18,7 @@ SOURCES += main.cpp\
         mainwindow.cpp \
     opencvbook.cpp \
     cvutils.cpp \
-    Line.cpp \
+    line.cpp \
     preprocess.cpp \
     boarddetector.cpp \
     corner.cpp \
@@ -29,10 +29,15 @@ SOURCES += main.cpp\
     regression.cpp \
     state.cpp \
     report.cpp \
-    piecedetector.cpp
+    piecedetector.cpp \
+    cornerrefiner.cpp \
+    cornercache.cpp \
+    boardrectifier.cpp \
+    debugsink.cpp \
+    log.cpp
 
 HEADERS  += mainwindow.h \
-    Line.h \
+    line.h \
     preprocess.h \
     boarddetector.h \
     cvutils.h \
@@ -50,7 +55,13 @@ HEADERS  += mainwindow.h \
     report.h \
     settings.h \
     global.h \
-    piecedetector.h
+    piecedetector.h \
+    cornerrefiner.h \
+    lattice.h \
+    cornercache.h \
+    boardrectifier.h \
+    debugsink.h \
+    log.h
 
 FORMS    += mainwindow.ui
 
@@ -1,18 +1,134 @@
 #include <fstream>
 #include <string>
 #include "board.h"
-#include "Line.h"
+#include "line.h"
 #include "square.h"
 #include "typedefs.h"
 #include "matrix.h"
 #include "squareExpander.h"
 #include "state.h"
 #include "global.h"
+#include "cornerrefiner.h"
+#include "piecedetector.h"
+#include "debugsink.h"
+#include "log.h"
+#include <opencv2/calib3d/calib3d.hpp>
 
 extern bool global::doDraw;
 
 std::vector<cv::Mat> global::channels; // forward declaration
 
+namespace {
+
+// Why a square could not be built. Squares at the image border fail every frame, so the
+// reason is kept as a code and only turned into a message when it is logged or thrown.
+enum SquareError {SQUARE_OK = 0, SQUARE_OUT_OF_BOUNDS, SQUARE_NEGATIVE_COORDINATE, SQUARE_INVALID};
+
+const char* squareErrorMessage(unsigned char error){
+    switch (error){
+    case SQUARE_OK: return "";
+    case SQUARE_OUT_OF_BOUNDS: return "Square is out of bounds";
+    case SQUARE_NEGATIVE_COORDINATE: return "One of the points has a negative coordinate";
+    default: return "Square could not be created";
+    }
+}
+
+// Builds square idx from the lattice points around it. Failures are recorded
+// rather than printed so the output does not depend on thread scheduling.
+class SquareBuilder : public cv::ParallelLoopBody
+{
+public:
+    SquareBuilder(const Points2d& lattice_, const std::vector<int>& radii_, size_t nCols_, Squares& squares_, std::vector<unsigned char>& errors_, bool keepOutOfBounds_ = false)
+        : lattice(lattice_), radii(radii_), nCols(nCols_), squares(squares_), errors(errors_), keepOutOfBounds(keepOutOfBounds_) {}
+
+    void operator()(const cv::Range& range) const {
+        size_t latticeCols = nCols + 1;
+        for (int idx = range.start; idx < range.end; idx++){
+            size_t i = idx / nCols;
+            size_t j = idx % nCols;
+            size_t ul = i * latticeCols + j;
+            size_t ur = ul + 1;
+            size_t ll = ul + latticeCols;
+            size_t lr = ll + 1;
+
+            if (cvutils::negCoordinate(lattice[ul]) || cvutils::negCoordinate(lattice[ur]) || cvutils::negCoordinate(lattice[lr]) || cvutils::negCoordinate(lattice[ll])){
+                errors[idx] = SQUARE_NEGATIVE_COORDINATE;
+                continue;
+            }
+            try{
+                Square square(lattice[ul], lattice[ur], lattice[lr], lattice[ll], cv::Vec4i(radii[ul], radii[ur], radii[lr], radii[ll]));
+                if (square.isOutOfBounds() && !keepOutOfBounds){
+                    errors[idx] = SQUARE_OUT_OF_BOUNDS;
+                    continue;
+                }
+                squares[idx] = square;
+            }
+            catch(std::exception&){
+                errors[idx] = SQUARE_INVALID;
+            }
+        }
+        logging::flush(); // pool threads are never joined
+    }
+
+private:
+    const Points2d& lattice;
+    const std::vector<int>& radii;
+    size_t nCols;
+    Squares& squares;
+    std::vector<unsigned char>& errors;
+    bool keepOutOfBounds;
+};
+
+// Extrapolates a new square from each base square
+class ExpandBody : public cv::ParallelLoopBody
+{
+public:
+    ExpandBody(StridedView<const Square> baseSquares_, Direction dir_, Squares& newSquares_, std::vector<unsigned char>& errors_)
+        : baseSquares(baseSquares_), dir(dir_), newSquares(newSquares_), errors(errors_) {}
+
+    void operator()(const cv::Range& range) const {
+        for (int i = range.start; i < range.end; i++){
+            try{
+                SquareExpander se(baseSquares[i], dir);
+                if (se.leavesImage()){
+                    errors[i] = SQUARE_NEGATIVE_COORDINATE;
+                    continue;
+                }
+                newSquares[i] = se.getSquare();
+            }
+            catch(std::exception&){
+                errors[i] = SQUARE_INVALID;
+            }
+        }
+        logging::flush(); // pool threads are never joined
+    }
+
+private:
+    StridedView<const Square> baseSquares;
+    Direction dir;
+    Squares& newSquares;
+    std::vector<unsigned char>& errors;
+};
+
+// Forces the lazy classification of each square
+class ClassifyBody : public cv::ParallelLoopBody
+{
+public:
+    ClassifyBody(const Board& board_) : board(board_) {}
+
+    void operator()(const cv::Range& range) const {
+        for (int i = range.start; i < range.end; i++){
+            board.elementAt(i).getSquareType();
+        }
+        logging::flush(); // pool threads are never joined
+    }
+
+private:
+    const Board& board;
+};
+
+} // end anonymous namespace
+
 Board::Board()
 {
     piecesDetected = false;
@@ -20,7 +136,7 @@ Board::Board()
     nRows = 0;
 }
 
-void Board::initBoard(Lines hlinesSorted, Lines vlinesSorted)
+void Board::initBoard(const Lines& hlinesSorted, const Lines& vlinesSorted, const Settings::BoardSettings& settings_)
 {    
     if (hlinesSorted.empty()){
         throw std::invalid_argument("Vector with horizontal lines does not contain any elements");
@@ -29,54 +145,247 @@ void Board::initBoard(Lines hlinesSorted, Lines vlinesSorted)
     if (vlinesSorted.empty()){
         throw std::invalid_argument("Vector with vertical lines does not contain any elements");
     }
+    settings = settings_;
+    invalidateHomography(); // fitted to the squares of a previous frame
     piecesDetected = false;
+    pieces.clear();            // the pieces, their colors and the black squares of a previous frame
+    pieceColors.clear();
+    pieceConfidences.clear();
+    circles.clear();
+    blackSquares.clear();
+    rowTypes.clear();
+    colTypes.clear();
+    Square::getCornerCache().clear(); // corners of a previous frame are stale
+    Square::getCornerCache().setRings(settings.cornerRings);
+    Square::resetCounters();
     nCols = vlinesSorted.size() - 1;
     nRows = hlinesSorted.size() - 1;
 
-    for (size_t i = 0; i < nRows; ++i) {
-        Line hlineUpper = hlinesSorted.at(i);
-        Line hlineLower = hlinesSorted.at(i+1);
-        bool addRow = true;
-        Squares row;
-        for (size_t j = 0; j < nCols; ++j) {
-            Line vlineLeft = vlinesSorted.at(j);
-            Line vlineRight = vlinesSorted.at(j+1);
-
-            cv::Point2d upperLeft, upperRight, lowerLeft, lowerRight;
-
+    // Lattice points where the lines intersect, stored row by row
+    size_t latticeCols = nCols + 1;
+    Points2d& lattice = frameLattice;
+    lattice.assign((nRows + 1) * latticeCols, cv::Point2d());
+    for (size_t i = 0; i <= nRows; ++i) {
+        for (size_t j = 0; j <= nCols; ++j) {
+            hlinesSorted[i].Intersection(vlinesSorted[j], lattice[i * latticeCols + j]);
+        }
+    }
 
-            int check = hlineUpper.Intersection(vlineLeft, upperLeft);
-            check = hlineUpper.Intersection(vlineRight, upperRight);
-            check = hlineLower.Intersection(vlineLeft, lowerLeft);
-            check = hlineLower.Intersection(vlineRight, lowerRight);
+    if (settings.refineCorners){
+        double duration = static_cast<double>(cv::getTickCount());
+        if (!refiner || refiner->getRadius() != settings.refineRadius || refiner->getMaxIterations() != settings.refineIterations){
+            refiner = std::make_shared<CornerRefiner>(global::image, settings.refineRadius, settings.refineIterations);
+        } else {
+            refiner->setImage(global::image); // the fit only depends on the window, keep it
+        }
+        size_t nRefined = refiner->refine(lattice);
+        duration = (static_cast<double>(cv::getTickCount()) - duration) / cv::getTickFrequency();
+        LOG_INFO("Refined " << nRefined << " of " << lattice.size() << " lattice points in " << duration * 1000 << " ms");
+    }
 
-            Square sq;
-            try{
-                Square square(upperLeft, upperRight, lowerRight, lowerLeft);
-                if (square.isOutOfBounds()){
-                    throw std::invalid_argument("Square is out of bounds");
-                }
-                sq = square;
+    // Corner patches follow the local square size, the mean distance to the neighbouring lattice points
+    std::vector<int>& radii = frameRadii;
+    radii.assign(lattice.size(), 0);
+    int maxRadius = std::min(settings.maxCornerRadius, Corner::maxRadius);
+    auto cornerRadius = [&](double sum, int n){
+        int radius = n > 0 ? cvRound(settings.cornerRadiusFraction * sum / n) : settings.minCornerRadius;
+        return std::max(settings.minCornerRadius, std::min(maxRadius, radius));
+    };
+    if (nRows == BoardIndex::rows && nCols == BoardIndex::cols){
+        // the neighbours of every vertex of a board sized grid are known at compile time
+        for (size_t v = 0; v < BoardIndex::nVertices; v++){
+            double sum = 0;
+            int n = 0;
+            for (size_t dir = 0; dir < 4; dir++){
+                size_t w = BoardTables::neighbours::values[v * 4 + dir];
+                if (w != BoardIndex::none) {sum += cv::norm(lattice[v] - lattice[w]); n++;}
+            }
+            radii[v] = cornerRadius(sum, n);
+        }
+    } else {
+        for (size_t i = 0; i <= nRows; ++i) {
+            for (size_t j = 0; j <= nCols; ++j) {
+                size_t v = i * latticeCols + j;
+                double sum = 0;
+                int n = 0;
+                if (j > 0)     {sum += cv::norm(lattice[v] - lattice[v - 1]); n++;}
+                if (j < nCols) {sum += cv::norm(lattice[v] - lattice[v + 1]); n++;}
+                if (i > 0)     {sum += cv::norm(lattice[v] - lattice[v - latticeCols]); n++;}
+                if (i < nRows) {sum += cv::norm(lattice[v] - lattice[v + latticeCols]); n++;}
+                radii[v] = cornerRadius(sum, n);
             }
-            catch(std::exception& e){
-                std::cout << e.what() << std::endl;
+        }
+    }
+
+    // Squares only read their own four lattice points, so they are built in parallel. Rows are assembled afterwards in order, which keeps the board deterministic.
+    double duration = static_cast<double>(cv::getTickCount());
+    size_t nSquares = nRows * nCols;
+    Squares& candidates = frameSquares;
+    std::vector<unsigned char>& errors = frameErrors;
+    candidates.assign(nSquares, Square());
+    errors.assign(nSquares, SQUARE_OK);
+    cv::parallel_for_(cv::Range(0, (int) nSquares), SquareBuilder(lattice, radii, nCols, candidates, errors));
+    duration = (static_cast<double>(cv::getTickCount()) - duration) / cv::getTickFrequency();
+    LOG_INFO("Built " << nSquares << " squares in " << duration * 1000 << " ms");
+
+    std::vector<size_t>& acceptedRows = frameRows;
+    acceptedRows.clear();
+    for (size_t i = 0; i < nRows; ++i) {
+        bool addRow = true;
+        for (size_t j = 0; j < nCols; ++j) {
+            unsigned char error = errors[i * nCols + j];
+            if (error != SQUARE_OK){
+                LOG_DEBUG("Square " << i << "," << j << ": " << squareErrorMessage(error));
                 addRow = false;
             }
-            row.push_back(sq);
         }
         if (addRow){
-            elements.insert(elements.end(), row.begin(), row.end());
-        } else {
-            nRows--;
+            acceptedRows.push_back(i);
         }
     }
+
+    reset(acceptedRows.size(), nCols); // reuses the storage of the previous frame
+    for (size_t i = 0; i < acceptedRows.size(); ++i) {
+        std::copy(candidates.begin() + acceptedRows[i] * nCols, candidates.begin() + (acceptedRows[i] + 1) * nCols, rowView(i).begin());
+    }
     removeOutOfBounds();
+
+    // The board is expanded to BoardIndex::rows x BoardIndex::cols squares at most and may grow
+    // on either side, leave room for that so expanding never moves the squares already found
+    size_t missingRows = nRows < BoardIndex::rows ? BoardIndex::rows - nRows : 0;
+    size_t missingCols = nCols < BoardIndex::cols ? BoardIndex::cols - nCols : 0;
+    reserveHeadroom(missingRows, missingRows, missingCols, missingCols);
+}
+
+int Board::squareId(cv::Point2d point) const
+{
+    if (!updateHomography())
+        return (int) size();
+
+    const double* h = imageToGrid.ptr<double>();
+    double w = h[6] * point.x + h[7] * point.y + h[8];
+    cv::Point2d grid((h[0] * point.x + h[1] * point.y + h[2]) / w, (h[3] * point.x + h[4] * point.y + h[5]) / w);
+    return squareAtGrid(grid, point);
+}
+
+std::vector<int> Board::squareIds(const Points2d& points) const
+{
+    std::vector<int> ids(points.size(), (int) size());
+    if (points.empty() || !updateHomography())
+        return ids;
+
+    Points2d grid;
+    cv::perspectiveTransform(points, grid, imageToGrid);
+    for (size_t i = 0; i < points.size(); i++){
+        ids[i] = squareAtGrid(grid[i], points[i]);
+    }
+    return ids;
+}
+
+bool Board::getHomography(cv::Mat& gridToImage_) const
+{
+    if (!updateHomography())
+        return false;
+    gridToImage_ = gridToImage;
+    return true;
+}
+
+int Board::squareAtGrid(cv::Point2d grid, cv::Point2d point) const
+{
+    int row = (int) std::floor(grid.y);
+    int col = (int) std::floor(grid.x);
+
+    // the homography is a least squares fit, so check the square and close to its borders the neighbours too
+    for (int dr = 0; dr <= 2; dr++){
+        for (int dc = 0; dc <= 2; dc++){
+            int r = row + (dr == 2 ? -1 : dr);
+            int c = col + (dc == 2 ? -1 : dc);
+            if (r < 0 || c < 0 || r >= (int) nRows || c >= (int) nCols)
+                continue;
+            size_t idx = getIndex(r, c);
+            if (elementAt(idx).containsPoint(point))
+                return (int) idx;
+        }
+    }
+    return (int) size();
 }
 
-int Board::squareId(cv::Point2d point){ // TODO TEST!
-    Squares::iterator it = std::find_if(elements.begin(), elements.end(), [&](Square square){return square.containsPoint(point);});
-    int squareId = std::distance(elements.begin(), it);
-    return squareId;
+bool Board::updateHomography() const
+{
+    if (empty() || size() != nRows * nCols)
+        return false;
+
+    if (!imageToGrid.empty())
+        return true;
+
+    std::vector<cv::Point2f>& imagePoints = homographyImagePoints;
+    std::vector<cv::Point2f>& gridPoints = homographyGridPoints;
+    imagePoints.clear();
+    gridPoints.clear();
+    BoardVertices vertices;
+    if (getVertices(vertices)){
+        // the final board, every vertex once
+        imagePoints.resize(BoardVertices::size);
+        gridPoints.resize(BoardVertices::size);
+        for (size_t v = 0; v < BoardVertices::size; v++){
+            imagePoints[v] = cv::Point2f((float) vertices[v].x, (float) vertices[v].y);
+            gridPoints[v] = cv::Point2f((float) (v % BoardVertices::cols), (float) (v / BoardVertices::cols));
+        }
+    } else {
+        imagePoints.reserve(size() * 4);
+        gridPoints.reserve(size() * 4);
+        for (size_t idx = 0; idx < size(); idx++){
+            std::pair<size_t,size_t> rowcol = getRowCol(idx);
+            for (size_t corner = 0; corner < 4; corner++){
+                cv::Point2d p = elementAt(idx).getCornerpoint(corner);
+                imagePoints.push_back(cv::Point2f((float) p.x, (float) p.y));
+                gridPoints.push_back(cv::Point2f(rowcol.second + ((corner == 1 || corner == 2) ? 1 : 0), rowcol.first + (corner >= 2 ? 1 : 0)));
+            }
+        }
+    }
+
+    cv::Mat H = cv::findHomography(imagePoints, gridPoints, 0);
+    if (H.empty()){
+        imageToGrid.release();
+        return false;
+    }
+    H.convertTo(imageToGrid, CV_64F);
+    gridToImage = imageToGrid.inv();
+    return true;
+}
+
+bool Board::removeRowRequest(size_t idx)
+{
+    invalidateHomography();
+    return matrix<Square>::removeRowRequest(idx);
+}
+
+std::vector<size_t> Board::removeRowsRequest(std::vector<size_t> rows)
+{
+    invalidateHomography();
+    return matrix<Square>::removeRowsRequest(rows);
+}
+
+bool Board::removeColRequest(size_t idx)
+{
+    invalidateHomography();
+    return matrix<Square>::removeColRequest(idx);
+}
+
+std::vector<size_t> Board::removeColsRequest(std::vector<size_t> cols)
+{
+    invalidateHomography();
+    return matrix<Square>::removeColsRequest(cols);
+}
+
+void Board::classifySquares()
+{
+    // Squares are typed on first use. Classifying the squares left after pruning in one go
+    // spreads the corner classification over all cores instead of doing it row by row.
+    double duration = static_cast<double>(cv::getTickCount());
+    cv::parallel_for_(cv::Range(0, (int) size()), ClassifyBody(*this));
+    duration = (static_cast<double>(cv::getTickCount()) - duration) / cv::getTickFrequency();
+    LOG_INFO("Classified " << size() << " squares in " << duration * 1000 << " ms");
 }
 
 void Board::determineRowTypes()
@@ -84,14 +393,13 @@ void Board::determineRowTypes()
     rowTypes.clear();
 
     for (size_t i = 0; i < nRows; i++){
-        std::vector<int> histogram(5,0);
-        for (size_t j = 0; j < nCols; j++){
-            const Square& square = getElementRef(i, j);
+        size_t histogram[5] = {0, 0, 0, 0, 0};
+        for (const Square& square : rowView(i)){
             int type = square.getSquareType();
             ++histogram[ type ];
         }
 
-        int vote = std::max_element( histogram.begin(), histogram.end() ) - histogram.begin();
+        int vote = std::max_element( histogram, histogram + 5 ) - histogram;
         if (vote == 0 && histogram[0] < nCols-1) // if there are two or more votes for other categories
         {
             rowTypes.push_back(vote);
@@ -107,14 +415,13 @@ void Board::determineColTypes()
     colTypes.clear();
 
     for (size_t i = 0; i < nCols; i++){
-        std::vector<size_t> histogram(5,0);
-        for (size_t j = 0; j < nRows; j++){
-            const Square& square = getElementRef(j, i);
+        size_t histogram[5] = {0, 0, 0, 0, 0};
+        for (const Square& square : colView(i)){
             int type = square.getSquareType();
             ++histogram[ type ];
         }
 
-        int vote = std::max_element( histogram.begin(), histogram.end() ) - histogram.begin();
+        int vote = std::max_element( histogram, histogram + 5 ) - histogram;
         if (vote == 0 && histogram[0] < nCols-1) // if there are two or more votes for other categories
         {
             colTypes.push_back(vote);
@@ -128,11 +435,11 @@ void Board::determineColTypes()
 void Board::removeOutOfBounds(){
     std::vector<size_t> delRow;
     std::vector<size_t> delCol;
-    for (size_t i = 0; i < elements.size(); i++){
+    for (size_t i = 0; i < size(); i++){
         std::pair<size_t,size_t> rowcol = getRowCol(i);
         int row = rowcol.first;
         int col = rowcol.second;
-        if (elements[i].isOutOfBounds()){
+        if (elementAt(i).isOutOfBounds()){
             delRow.push_back(row);
             delCol.push_back(col);
         }
@@ -148,16 +455,20 @@ void Board::removeOutOfBounds(){
     if (checkColsRemoved.size() != delCol.size() || checkRowsRemoved.size() != delRow.size()){
         throw std::invalid_argument("Make sure whole board is within global::image frame");
     }
-    std::cout << "Cols removed because contained an out of bounds square: ";
-    for (size_t i = 0; i < checkColsRemoved.size(); i++){
-        std::cout << checkColsRemoved[i] << ",";
+    if (logging::enabled(LOG_LEVEL_DEBUG)){
+        logging::Record cols(LOG_LEVEL_DEBUG);
+        cols << "Cols removed because contained an out of bounds square: ";
+        for (size_t i = 0; i < checkColsRemoved.size(); i++){
+            cols << checkColsRemoved[i] << ",";
+        }
     }
-    std::cout << std::endl;
-    std::cout << "Rows removed because contained an out of bounds square: ";
-    for (size_t i = 0; i < checkRowsRemoved.size(); i++){
-        std::cout << checkRowsRemoved[i] << ",";
+    if (logging::enabled(LOG_LEVEL_DEBUG)){
+        logging::Record rows(LOG_LEVEL_DEBUG);
+        rows << "Rows removed because contained an out of bounds square: ";
+        for (size_t i = 0; i < checkRowsRemoved.size(); i++){
+            rows << checkRowsRemoved[i] << ",";
+        }
     }
-    std::cout << std::endl;
 
 }
 
@@ -179,8 +490,8 @@ std::vector<int> Board::getColTypes()
 
 void Board::draw()
 {
-    if (elements.empty()){
-        std::cout << "This board is empty, can't draw" << std::endl;
+    if (empty()){
+        LOG_WARN("This board is empty, can't draw");
         return;
     }
 
@@ -191,15 +502,15 @@ void Board::draw()
     global::image.copyTo(img_draw);
     cv::cvtColor(img_draw, img_draw, cv::COLOR_GRAY2BGR);
     cv::RNG rng = cv::RNG(1234);
-    for (size_t i = 0; i < elements.size(); i++) {
+    for (size_t i = 0; i < size(); i++) {
 
         cv::Scalar col = cv::Scalar(rng.uniform(0,255), rng.uniform(0,255), rng.uniform(0,255));
-        Points2d cps = elements.at(i).getCornerpointsSorted();
+        Points2d cps = elementAt(i).getCornerpointsSorted();
         if (cps.size() != 4){
             throw std::invalid_argument("Need four corner points to draw square");
         }
         if (cvutils::anyNegCoordinate(cps)){
-            std::cout << "At least one point has a negative index, cannot draw" << std::endl;
+            LOG_WARN("At least one point has a negative index, cannot draw");
             return;
         } else {
             Points cornerpoints = cvutils::doubleToInt(cps);
@@ -226,7 +537,7 @@ void Board::drawWithPieces()
         int idx = piece.first;
         int id = piece.second;
 
-        Square &square = elements[idx];
+        Square &square = elementAt(idx);
         auto center = square.getCenter();
         cv::Scalar col;
         id > 0 ? col = cols[0] : col = cols[1];
@@ -248,7 +559,7 @@ void Board::writeImgWithPiecesToGlobal()
         int idx = piece.first;
         int id = piece.second;
 
-        Square &square = elements[idx];
+        Square &square = elementAt(idx);
         auto center = square.getCenter();
         cv::Scalar col;
         id > 0 ? col = cols[0] : col = cols[1];
@@ -259,40 +570,34 @@ void Board::writeImgWithPiecesToGlobal()
 
 void Board::write(std::string filename)
 {
-    if (elements.empty()){
-        std::cout << "This board is empty, can't write" << std::endl;
+    if (empty()){
+        LOG_WARN("This board is empty, can't write");
         return;
     }
 
     if (!global::image.data){
         throw std::invalid_argument("draw() has no global::image to draw on");
     }
-    cv::Mat img_draw;
-    global::image.copyTo(img_draw);
-    cv::cvtColor(img_draw, img_draw, cv::COLOR_GRAY2BGR);
-    cv::RNG rng = cv::RNG(1234);
-
-    for (size_t i = 0; i < elements.size(); i++) {
-        cv::Scalar col = cv::Scalar(rng.uniform(0,255), rng.uniform(0,255), rng.uniform(0,255));
-        Points2d cps = elements.at(i).getCornerpointsSorted();
-        if (cvutils::anyNegCoordinate(cps)){
-            std::cout << "At least one point has a negative index, cannot draw" << std::endl;
-            return;
-        } else {
-            Points cornerpoints = cvutils::doubleToInt(cps);
-            cv::fillConvexPoly(img_draw, cornerpoints, col);
+    // same rendering as the reports written by DebugSink, but on the calling thread
+    Points2d corners;
+    corners.reserve(size() * 4);
+    for (size_t i = 0; i < size(); i++){
+        for (size_t corner = 0; corner < 4; corner++){
+            corners.push_back(elementAt(i).getCornerpoint(corner));
         }
     }
-
-    cv::imwrite(filename, img_draw);
+    cv::Mat img_draw;
+    if (DebugSink::render(global::image, corners, img_draw)){
+        cv::imwrite(filename, img_draw);
+    }
 }
 
 void Board::writeLayerReport(std::string filename)
 {
     std::ofstream layerReport;
     layerReport.open(filename);
-    for (int i = 0; i < 64; i++){
-        const Square &square = elements[i];
+    for (size_t i = 0; i < BoardIndex::nSquares; i++){
+        const Square &square = elementAt(i);
         std::vector<Corner> corners = square.getCorners();
         for (size_t j = 0; j < 4; j++){
             Corner corner = corners[j];
@@ -314,48 +619,54 @@ std::pair<int,int> Board::getStatus()
 {
     std::pair<int,int> status; //row, col
 
-    status.first = 8 - nRows; // number of rows needed to add/shrink
-    status.second = 8 - nCols;
+    status.first = (int) BoardIndex::rows - (int) nRows; // number of rows needed to add/shrink
+    status.second = (int) BoardIndex::cols - (int) nCols;
 
     return status;
 }
 
+bool Board::getVertices(BoardVertices& vertices) const
+{
+    if (nRows != BoardIndex::rows || nCols != BoardIndex::cols){
+        return false;
+    }
+
+    // each vertex is taken from the first square that has it as a corner
+    for (size_t v = 0; v < BoardIndex::nVertices; v++){
+        for (size_t corner = 0; corner < 4; corner++){
+            size_t idx = BoardTables::sharedBy::values[v * 4 + corner];
+            if (idx != BoardIndex::none){
+                vertices[v] = elementAt(idx).getCornerpoint(corner);
+                break;
+            }
+        }
+    }
+    return true;
+}
+
 void Board::expand(Direction dir)
 {
-    size_t size;
-    Squares baseSquares;
     switch(dir){
     case UP:
-        size = nCols;
-        baseSquares = this->getRow(0);
-        std::cout << "Adding row to top of board" << std::endl;
+        LOG_DEBUG("Adding row to top of board");
         break;
     case DOWN:
-        size = nCols;
-        baseSquares = this->getRow(nRows-1);
-        std::cout << "Adding row to bottom of board" << std::endl;
+        LOG_DEBUG("Adding row to bottom of board");
         break;
     case LEFT:
-        size = nRows;
-        baseSquares = this->getCol(0);
-        std::cout << "Adding column to left of board" << std::endl;
+        LOG_DEBUG("Adding column to left of board");
         break;
     case RIGHT:
-        size = nRows;
-        baseSquares = this->getCol(nCols-1);
-        std::cout << "Adding column to right of board" << std::endl;
+        LOG_DEBUG("Adding column to right of board");
         break;
-
     }
 
-    Squares newsquares(size);
-    for (size_t i = 0; i < size; i++){
-        SquareExpander se(baseSquares[i], dir);
-        //if (!success)
-        //  break;
-        newsquares[i] = se.getSquare();
+    Squares& newsquares = edgeSquares;
+    if (!extrapolateEdge(dir, newsquares)){
+        expandBySquare(dir, newsquares);
     }
 
+    invalidateHomography();
     switch(dir){  // TODO: use function pointers instead and define them in the previous switch
     case UP:
         this->prependRow(newsquares);
@@ -372,21 +683,174 @@ void Board::expand(Direction dir)
     }
 }
 
+int Board::cropToWindow(int row, int col)
+{
+    int rows = (int) nRows;
+    int cols = (int) nCols;
+    for (int i = 0; i < row; i++)
+        removeRowRequest(0);
+    for (int i = row + (int) BoardIndex::rows; i < rows; i++)
+        removeRowRequest(nRows - 1);
+    for (int i = 0; i < col; i++)
+        removeColRequest(0);
+    for (int i = col + (int) BoardIndex::cols; i < cols; i++)
+        removeColRequest(nCols - 1);
+
+    int expansions = 0;
+    for (int i = row; i < 0; i++, expansions++)
+        expand(UP);
+    for (int i = rows; i < row + (int) BoardIndex::rows; i++, expansions++)
+        expand(DOWN);
+    for (int i = col; i < 0; i++, expansions++)
+        expand(LEFT);
+    for (int i = cols; i < col + (int) BoardIndex::cols; i++, expansions++)
+        expand(RIGHT);
+    return expansions;
+}
+
+const std::vector<int>& Board::getTypeSums() const
+{
+    static const int types[3] = {4, 3, 2}; // inner, border, corner
+    size_t stride = nCols + 1;
+    size_t plane = (nRows + 1) * stride;
+    frameTypeSums.assign(3 * plane, 0);
+    for (size_t t = 0; t < 3; t++){
+        int* sums = &frameTypeSums[t * plane];
+        for (size_t r = 0; r < nRows; r++){
+            int rowSum = 0;
+            for (size_t c = 0; c < nCols; c++){
+                rowSum += getElementRef(r, c).getSquareType() == types[t] ? 1 : 0;
+                sums[(r + 1) * stride + c + 1] = sums[r * stride + c + 1] + rowSum;
+            }
+        }
+    }
+    return frameTypeSums;
+}
+
+bool Board::extrapolateEdge(Direction dir, Squares& newsquares)
+{
+    if (!updateHomography())
+        return false;
+
+    // The vertices along the edge of the board, and the grid step out of the board
+    bool horizontal = (dir == UP || dir == DOWN);
+    size_t n = horizontal ? nCols : nRows;
+    size_t edge = (dir == UP || dir == LEFT) ? 0 : (horizontal ? nRows - 1 : nCols - 1);
+    size_t cornerA, cornerB; // corner of each edge square on the edge, and of the last square
+    cv::Point2f gridEdge, gridAlong, gridStep;
+    switch(dir){
+    case UP:    cornerA = 0; cornerB = 1; gridEdge = cv::Point2f(0, 0); gridAlong = cv::Point2f(1, 0); gridStep = cv::Point2f(0, -1); break;
+    case DOWN:  cornerA = 3; cornerB = 2; gridEdge = cv::Point2f(0, (float) nRows); gridAlong = cv::Point2f(1, 0); gridStep = cv::Point2f(0, 1); break;
+    case LEFT:  cornerA = 0; cornerB = 3; gridEdge = cv::Point2f(0, 0); gridAlong = cv::Point2f(0, 1); gridStep = cv::Point2f(-1, 0); break;
+    default:    cornerA = 1; cornerB = 2; gridEdge = cv::Point2f((float) nCols, 0); gridAlong = cv::Point2f(0, 1); gridStep = cv::Point2f(1, 0); break;
+    }
+
+    Points2d& inner = edgeInner;
+    std::vector<int>& innerRadii = edgeInnerRadii;
+    std::vector<cv::Point2f>& grid = edgeGrid;
+    inner.resize(n + 1);
+    innerRadii.resize(n + 1);
+    grid.resize(2 * (n + 1));
+    for (size_t k = 0; k <= n; k++){
+        size_t s = std::min(k, n - 1);
+        size_t corner = k < n ? cornerA : cornerB;
+        const Square& square = horizontal ? getElementRef(edge, s) : getElementRef(s, edge);
+        inner[k] = square.getCornerpoint(corner);
+        innerRadii[k] = square.getCornerRadius(corner);
+        grid[k] = gridEdge + gridAlong * (float) k;
+        grid[n + 1 + k] = grid[k] + gridStep;
+    }
+
+    // The homography carries the perspective of the whole board, so one transform gives the
+    // spacing to the next line at every vertex. The step is added to the vertices the board
+    // already has, which keeps the new squares attached to it.
+    std::vector<cv::Point2f>& image = edgeImage;
+    cv::perspectiveTransform(grid, image, gridToImage);
+    Points2d& outer = edgeOuter;
+    outer.resize(n + 1);
+    for (size_t k = 0; k <= n; k++){
+        cv::Point2f step = image[n + 1 + k] - image[k];
+        outer[k] = inner[k] + cv::Point2d(step.x, step.y);
+    }
+
+    // Lay the two lines out as a lattice in board order, so SquareBuilder makes the new squares
+    Points2d& lattice = edgeLattice;
+    std::vector<int>& radii = edgeRadii;
+    lattice.resize(2 * (n + 1));
+    radii.resize(2 * (n + 1));
+    bool outerFirst = (dir == UP || dir == LEFT);
+    for (size_t k = 0; k <= n; k++){
+        size_t i = horizontal ? k : 2 * k;           // first line
+        size_t j = horizontal ? n + 1 + k : 2 * k + 1; // second line
+        lattice[i] = outerFirst ? outer[k] : inner[k];
+        lattice[j] = outerFirst ? inner[k] : outer[k];
+        radii[i] = radii[j] = innerRadii[k];
+    }
+
+    newsquares.assign(n, Square());
+    std::vector<unsigned char>& errors = edgeErrors;
+    errors.assign(n, SQUARE_OK);
+    cv::parallel_for_(cv::Range(0, (int) n), SquareBuilder(lattice, radii, horizontal ? n : 1, newsquares, errors, true));
+    for (size_t i = 0; i < n; i++){
+        if (errors[i] != SQUARE_OK)
+            throw std::invalid_argument(squareErrorMessage(errors[i]));
+    }
+    return true;
+}
+
+void Board::expandBySquare(Direction dir, Squares& newsquares)
+{
+    size_t size = (dir == UP || dir == DOWN) ? nCols : nRows;
+    StridedView<const Square> baseSquares;
+    switch(dir){
+    case UP:
+        baseSquares = this->rowView(0);
+        break;
+    case DOWN:
+        baseSquares = this->rowView(nRows-1);
+        break;
+    case LEFT:
+        baseSquares = this->colView(0);
+        break;
+    case RIGHT:
+        baseSquares = this->colView(nCols-1);
+        break;
+    }
+
+    newsquares.assign(size, Square());
+    std::vector<unsigned char>& errors = edgeErrors;
+    errors.assign(size, SQUARE_OK);
+    cv::parallel_for_(cv::Range(0, (int) size), ExpandBody(baseSquares, dir, newsquares, errors));
+    for (size_t i = 0; i < size; i++){
+        if (errors[i] != SQUARE_OK)
+            throw std::invalid_argument(squareErrorMessage(errors[i])); // same exception the serial loop would have thrown first
+    }
+}
+
 void Board::detectCircles(){
-    if (elements.size() == 0){
+    if (empty()){
         throw std::invalid_argument("Board is empty, can't detect circles");
     }
 
-    if (blackSquares.size() != 32)
+    if (blackSquares.size() != BoardIndex::nBlack)
         setBlackSquares();
 
+    std::vector<PieceDetector::Occupancy> occupancy;
+    if (settings.pieces.preclassify){
+        PieceDetector detector(*this, settings.pieces);
+        detector.classifyOccupancy(global::image);
+        occupancy = detector.getOccupancy();
+        LOG_INFO("Occupancy: skipped " << detector.getSkippedFraction() * 100 << "% of the squares");
+    }
+
     for (int i = 0; i < 3; i++){
         cv::Mat channel = global::channels[i];
 
-        for (size_t j = 0; j < 32; j++){
-            int id = blackSquareIdx[j];
+        for (size_t j = 0; j < BoardIndex::nBlack; j++){
+            int id = BoardTables::blackSquares::values[j];
             Square &square = blackSquares[j];
-            if (!square.containsPiece()){
+            bool empty = !occupancy.empty() && occupancy[id] == PieceDetector::EMPTY;
+            if (!square.containsPiece() && !empty){
                 cv::Vec3i circle;
                 bool pieceDetected = square.detectPieceWithHough(channel, circle);
 
@@ -400,7 +864,7 @@ void Board::detectCircles(){
 
 int Board::determinePieceColorThreshold(){
     for (size_t i = 0; i < circles.size(); i++){
-        Square& square = elements[circles[i].first];
+        Square& square = elementAt(circles[i].first);
         cv::Vec3i circle = circles[i].second;
         int col;
         bool colorDetermined = square.determinePieceColor(circle, col);
@@ -411,6 +875,25 @@ int Board::determinePieceColorThreshold(){
 
 void Board::detectPieces()
 {
+    if (settings.pieces.boardWideCircles){
+        double duration = static_cast<double>(cv::getTickCount());
+        PieceDetector detector(*this, settings.pieces);
+        if (settings.pieces.preclassify){
+            detector.classifyOccupancy(global::image);
+            LOG_INFO("Occupancy: skipped " << detector.getSkippedFraction() * 100 << "% of the squares");
+        }
+        circles = detector.detectCircles(global::channels);
+        std::vector<PieceDetector::PieceColor> colors = detector.classifyColors(global::image, circles);
+        for (size_t i = 0; i < circles.size(); i++){
+            pieces.push_back(std::make_pair(circles[i].first, colors[i].color));
+            pieceConfidences.push_back(colors[i].confidence);
+        }
+        duration = (static_cast<double>(cv::getTickCount()) - duration) / cv::getTickFrequency();
+        LOG_INFO("Detected " << circles.size() << " pieces in " << duration * 1000 << " ms" << (detector.isRectified() ? " on rectified tiles" : ""));
+        piecesDetected = true;
+        return;
+    }
+
     detectCircles();
     int threshold = determinePieceColorThreshold();
 
@@ -418,6 +901,7 @@ void Board::detectPieces()
         int piece;
         pieceColors.at(i) > threshold ? piece = 1 : piece = -1;
         pieces.push_back(std::make_pair(circles[i].first, piece));
+        pieceConfidences.push_back(std::min(1.0, std::abs(pieceColors.at(i) - threshold) / 127.5));
     }
     piecesDetected = true;
 }
@@ -431,10 +915,10 @@ State Board::initState(){
 
 void Board::setBlackSquares(){
     blackSquares.clear();
-    blackSquares.reserve(32);
+    blackSquares.reserve(BoardIndex::nBlack);
 
-    for (int i = 0; i < 32; i++){
-        blackSquares.push_back(elements[blackSquareIdx[i]]);
+    for (size_t i = 0; i < BoardIndex::nBlack; i++){
+        blackSquares.push_back(elementAt(BoardTables::blackSquares::values[i]));
     }
 }
 
@@ -1,24 +1,29 @@
 #ifndef GAMEBOARD_H
 #define GAMEBOARD_H
 
+#include <memory>
 #include <string>
 #include "typedefs.h"
 #include "matrix.h"
 #include "state.h"
+#include "settings.h"
+#include "lattice.h"
 
-const static std::vector<int> blackSquareIdx{1,3,5,7, 8,10,12,14, 17,19,21,23, 24,26,28,30, 33,35,37,39, 40,42,44,46, 49,51,53,55, 56,58,60,62};
+// The detected board is always 8x8
+typedef LatticeIndex<8,8> BoardIndex;
+typedef LatticeTables<8,8> BoardTables;
+typedef Lattice<cv::Point2d, 9, 9> BoardVertices;
+
+class CornerRefiner;
 
 class Board : public matrix<Square>
 {
 public:
     Board();
 
-    void initBoard(Lines sortedHorizontalLines, Lines sortedVerticalLines);
+    void initBoard(const Lines& sortedHorizontalLines, const Lines& sortedVerticalLines, const Settings::BoardSettings& settings = Settings::BoardSettings());
     std::vector<int> getRowTypes();
     std::vector<int> getColTypes();
-    size_t size(){return nRows * nCols;}
-
-    //int squareId(cv::Points2d point);
 
     void draw();
     void drawWithPieces();
@@ -26,30 +31,76 @@ public:
     void writeLayerReport(std::string filename);
 
     std::pair<int,int> getStatus();
+    bool getVertices(BoardVertices& vertices) const;
 
     void expand(Direction dir);
+    // Crops the board to the BoardIndex sized window whose upper left square is at (row, col) and
+    // expands it where the window hangs over the board, returns the rows and columns added
+    int cropToWindow(int row, int col);
+    // Summed-area tables of the inner, border and corner square types, one after the other,
+    // (rows+1)*(cols+1) each. Classifies the squares.
+    const std::vector<int>& getTypeSums() const;
+
+    // The matrix removals, dropping the homography of the squares they remove
+    bool removeRowRequest(size_t idx);
+    std::vector<size_t> removeRowsRequest(std::vector<size_t> rows);
+    bool removeColRequest(size_t idx);
+    std::vector<size_t> removeColsRequest(std::vector<size_t> cols);
 
-    int squareId(cv::Point2d point);
+    // Index of the square containing point, size() if it is outside the board
+    int squareId(cv::Point2d point) const;
+    std::vector<int> squareIds(const Points2d& points) const;
+    bool getHomography(cv::Mat& gridToImage) const; // board grid (col,row) to image coordinates
     void detectPieces();
+    const std::vector<double>& getPieceConfidences() const {return pieceConfidences;} // per detected piece
+    void classifySquares();
     State initState();
     void writeImgWithPiecesToGlobal();
 
 private:
+    Settings::BoardSettings settings;
     std::vector<int> rowTypes;
     std::vector<int> colTypes;
     std::vector<int> pieceColors;
     std::vector<std::pair<size_t, int>> pieces;
+    std::vector<double> pieceConfidences;
     std::vector<std::pair<size_t, cv::Vec3i>> circles;
     std::vector<Square> blackSquares;
 
+    // Buffers of initBoard, kept between frames so that once the board has seen a frame the
+    // next frames of the same size are built without allocating
+    Points2d frameLattice;
+    std::vector<int> frameRadii;
+    Squares frameSquares;
+    std::vector<unsigned char> frameErrors; // why a square failed, 0 if it was built
+    std::vector<size_t> frameRows;
+    std::shared_ptr<CornerRefiner> refiner;
+
+    // Buffers of expand and the window search, sized by the largest edge and grid seen so far
+    Squares edgeSquares;
+    Points2d edgeInner, edgeOuter, edgeLattice;
+    std::vector<int> edgeInnerRadii, edgeRadii;
+    std::vector<unsigned char> edgeErrors;
+    std::vector<cv::Point2f> edgeGrid, edgeImage;
+    mutable std::vector<int> frameTypeSums;
+
     void setBlackSquares();
     void determineRowTypes();
     void determineColTypes();
     void removeOutOfBounds();
+    bool extrapolateEdge(Direction dir, Squares& newsquares); // whole new row or column from the homography
+    void expandBySquare(Direction dir, Squares& newsquares);   // one SquareExpander per edge square
 
     void detectCircles();
     int determinePieceColorThreshold();
     bool piecesDetected;
+
+    // Homography fitted to all square corners, dropped whenever squares are added or removed
+    mutable cv::Mat imageToGrid, gridToImage;
+    mutable std::vector<cv::Point2f> homographyImagePoints, homographyGridPoints;
+    void invalidateHomography(){imageToGrid.release(); gridToImage.release();}
+    bool updateHomography() const;
+    int squareAtGrid(cv::Point2d grid, cv::Point2d point) const;
 };
 
 
@@ -1,30 +1,125 @@
 #include <vector>
 #include <cmath>
 #include <stdexcept>
+#include <algorithm>
 
 #include "boarddetector.h"
-#include "Line.h"
+#include "line.h"
 #include "cvutils.h"
 #include "square.h"
 #include "typedefs.h"
 #include "board.h"
 #include "squareExpander.h"
 #include "remover.h"
+#include "debugsink.h"
 #include "regression.h"
 #include "report.h"
 #include "global.h"
+#include "log.h"
 
 extern bool global::doDraw;
 
+namespace {
+
+cv::Point2d lineDirection(const Line& line){
+    if (line.points.size() == 2){
+        cv::Point2d dir = line.points[1] - line.points[0];
+        double length = cv::norm(dir);
+        if (length > 0)
+            return dir * (1.0 / length);
+    }
+    if (std::isinf(line.slope))
+        return cv::Point2d(0, 1);
+    double length = std::sqrt(1 + line.slope * line.slope);
+    return cv::Point2d(1 / length, line.slope / length);
+}
+
+double lineLength(const Line& line){
+    if (line.points.size() != 2)
+        return 1;
+    return cv::norm(line.points[1] - line.points[0]);
+}
+
+// Angle in degrees in [0,180)
+double lineAngle(const Line& line){
+    cv::Point2d dir = lineDirection(line);
+    double angle = std::atan2(dir.y, dir.x) * 180 / CV_PI;
+    if (angle < 0)
+        angle += 180;
+    if (angle >= 180)
+        angle -= 180;
+    return angle;
+}
+
+double angleDistance(double a, double b){
+    double diff = std::abs(a - b);
+    return std::min(diff, 180 - diff);
+}
+
+// Signed distance from center along normal to where the line crosses the normal
+bool normalOffset(const Line& line, const cv::Point2d& center, const cv::Point2d& normal, double& offset){
+    cv::Point2d dir = lineDirection(line);
+    cv::Point2d point = line.points.empty() ? cv::Point2d(0, line.yIntercept) : line.points[0];
+    double denom = normal.x * dir.y - normal.y * dir.x;
+    if (std::abs(denom) < 1e-6)
+        return false;
+    cv::Point2d w = point - center;
+    offset = (w.x * dir.y - w.y * dir.x) / denom;
+    return true;
+}
+
+typedef std::vector<std::pair<int,double> > Offsets;
+
+// Lines are ordered by where they cross the normal of their direction through the image centre
+Offsets sortedOffsets(const Lines& lines, const std::vector<int>& idx, double angle, bool horizontal){
+    double theta = angle * CV_PI / 180;
+    cv::Point2d normal(-std::sin(theta), std::cos(theta));
+    if ((horizontal && normal.y < 0) || (!horizontal && normal.x < 0))
+        normal = -normal; // top to bottom, left to right
+    cv::Point2d center(global::image.cols / 2.0, global::image.rows / 2.0);
+
+    Offsets offsets;
+    offsets.reserve(idx.size());
+    for (size_t i = 0; i < idx.size(); i++){
+        double offset;
+        if (normalOffset(lines[idx[i]], center, normal, offset))
+            offsets.push_back(std::make_pair(idx[i], offset));
+    }
+    std::sort(offsets.begin(), offsets.end(), cvutils::pairIsLess);
+    return offsets;
+}
+
+// Duplicate tolerance follows the square size. Small gaps are between duplicates,
+// large gaps between neighbouring lines of the lattice.
+double duplicateTolerance(const Offsets& offsets, double minDistance, double fraction){
+    if (offsets.size() < 2)
+        return minDistance;
+    std::vector<double> gaps(offsets.size() - 1);
+    for (size_t i = 1; i < offsets.size(); i++){
+        gaps[i-1] = offsets[i].second - offsets[i-1].second;
+    }
+    std::sort(gaps.begin(), gaps.end());
+    double upper = gaps[gaps.size() * 3 / 4];
+    std::vector<double>::iterator first = std::lower_bound(gaps.begin(), gaps.end(), upper / 2);
+    double squareSize = *(first + (gaps.end() - first) / 2);
+    return std::max(minDistance, squareSize * fraction);
+}
+
+} // end anonymous namespace
+
 BoardDetector::~BoardDetector()
 {
 }
 
-BoardDetector::BoardDetector(std::vector<Line> lines_)
+BoardDetector::BoardDetector(std::vector<Line> lines_, Settings::BoardSettings settings_, cv::Mat edges_)
 {
 
     lines = lines_;
-    //detectChessboardRegion(); // TODO Use template matching to find rough region of chessboard
+    settings = settings_;
+    edges = edges_;
+    window.row = window.col = window.score = window.runnerUp = 0;
+    // the rough board region is proposed by Preprocess, lines are only detected inside it
+    Report::StageTimer timer(report, "categorizeLines");
     categorizeLines();
 
 
@@ -47,20 +142,61 @@ Corners BoardDetector::getCorners()
 
 bool BoardDetector::detect(Board& dst, std::string *reportPath)
 {
-    std::cout << "Horizontal lines: " << hlinesSorted.size() << std::endl;
-    dst.initBoard(hlinesSorted, vlinesSorted);
+    LOG_DEBUG("Horizontal lines: " << hlinesSorted.size());
+    report.expansions = 0;
+    report.confidence = 0;
+    report.detected = false;
+    {
+        Report::StageTimer timer(report, "initBoard");
+        dst.initBoard(hlinesSorted, vlinesSorted, settings);
+    }
 
 
     if (hlinesSorted.size() < 2 || vlinesSorted.size() < 2)
         return false;
 
-    if (global::doDraw) dst.draw();
+    if (global::doDraw) DebugSink::instance().show(dst, global::image, "initBoard");
 
     if (reportPath != 0){
         std::string filename1 = *reportPath + "initBoard.png";
-        dst.write(filename1);
+        DebugSink::instance().write(dst, global::image, filename1);
     }
 
+    if (settings.windowSearch){
+        Report::StageTimer timer(report, "windowSearch");
+        fitBoardWindow(dst);
+        report.confidence = window.score / (double) BoardIndex::nSquares;
+        if (global::doDraw) DebugSink::instance().show(dst, global::image, "boardAfterWindowSearch");
+        if (reportPath != 0){
+            DebugSink::instance().write(dst, global::image, *reportPath + "boardAfterWindowSearch.png");
+        }
+    } else {
+        Report::StageTimer timer(report, "pruneAndExpand");
+        pruneAndExpand(dst, reportPath);
+        if (dst.getNumRows() == BoardIndex::rows && dst.getNumCols() == BoardIndex::cols){
+            int matches = 0;
+            for (size_t i = 0; i < BoardIndex::nSquares; i++)
+                matches += dst.elementAt(i).getSquareType() == BoardTables::expectedTypes::values[i] ? 1 : 0;
+            report.confidence = matches / (double) BoardIndex::nSquares;
+        }
+    }
+    report.squaresCreated = Square::getCreatedCount();
+    report.squaresClassified = Square::getClassifiedCount();
+    report.detected = dst.getNumRows() == BoardIndex::rows && dst.getNumCols() == BoardIndex::cols;
+
+    const CornerCache& cache = Square::getCornerCache();
+    LOG_INFO("Corner cache: " << cache.getMisses() << " corners classified, " << cache.getHits() << " reused, "
+             << cache.getDuplicates() << " classified twice by racing threads");
+    LOG_INFO("Squares: " << Square::getClassifiedCount() << " of " << Square::getCreatedCount() << " classified, "
+             << Square::getAvoidedClassifications() << " classifications avoided");
+
+    //const Square& square = possibleBoard.getRef(0);
+    //bool check = square.containsPoint(cv::Point2d(200,200));
+    return true;
+}
+
+void BoardDetector::pruneAndExpand(Board& dst, std::string *reportPath)
+{
     // INITIAL PRUNING
     size_t initrows = dst.getNumRows();
     size_t initcols = dst.getNumCols();
@@ -83,13 +219,13 @@ bool BoardDetector::detect(Board& dst, std::string *reportPath)
         dst.removeColsRequest(prunecols);
     }
 
-    if (global::doDraw) dst.draw();
+    if (global::doDraw) DebugSink::instance().show(dst, global::image, "boardAfterPruning");
 
     if (reportPath != 0){
-        dst.write(*reportPath + "boardAfterPruning.png");
+        DebugSink::instance().write(dst, global::image, *reportPath + "boardAfterPruning.png");
     }
 
-    Remover remover(dst);
+    Remover remover(dst, settings.removeRowFraction, settings.removeColFraction);
 
     filterBasedOnSquareSize(dst, remover);
     indices colreq1 = remover.getCurrentColRequests();
@@ -97,13 +233,14 @@ bool BoardDetector::detect(Board& dst, std::string *reportPath)
 
     remover.remove();
 
-    if (global::doDraw) dst.draw();
+    if (global::doDraw) DebugSink::instance().show(dst, global::image, "boardAfterFilterBySize");
 
     if (reportPath != 0){
-        dst.write(*reportPath + "boardAfterFilterBySize.png");
+        DebugSink::instance().write(dst, global::image, *reportPath + "boardAfterFilterBySize.png");
         // possibleBoard.writeLayerReport(*reportPath + "layerReportAfterFilterBySize.csv");
     }
 
+    dst.classifySquares(); // only the squares that survived pruning and the size filter are classified
     filterBasedOnRowType(dst, remover);
     indices colreq2 = remover.getCurrentColRequests();
     indices rowreq2 = remover.getCurrentRowRequests();
@@ -115,17 +252,17 @@ bool BoardDetector::detect(Board& dst, std::string *reportPath)
     indices rowreq3 = remover.getCurrentRowRequests();
 
     remover.remove();
-    if (global::doDraw) dst.draw();
+    if (global::doDraw) DebugSink::instance().show(dst, global::image, "boardAfterFilterByType");
 
     if (reportPath != 0){
-        dst.write(*reportPath + "boardAfterFilterByType.png");
+        DebugSink::instance().write(dst, global::image, *reportPath + "boardAfterFilterByType.png");
     }
 
     filterBasedOnSquareSize(dst, remover);
     remover.remove();
-    if (global::doDraw) dst.draw();
+    if (global::doDraw) DebugSink::instance().show(dst, global::image, "boardAfterFilterBySize2");
     if (reportPath != 0){
-        dst.write(*reportPath + "boardAfterFilterBySize2.png");
+        DebugSink::instance().write(dst, global::image, *reportPath + "boardAfterFilterBySize2.png");
     }
     std::pair<int,int> status = dst.getStatus();
 
@@ -138,7 +275,7 @@ bool BoardDetector::detect(Board& dst, std::string *reportPath)
     while (addRows){
         requestRowExpansion(dst);
         status = dst.getStatus();
-        if (global::doDraw) dst.draw();
+        if (global::doDraw) DebugSink::instance().show(dst, global::image, "boardAfterRowExpansion");
         if (status.first <= 0)
             addRows = false;
     }
@@ -149,14 +286,83 @@ bool BoardDetector::detect(Board& dst, std::string *reportPath)
     while (addColumns){
         requestColumnExpansion(dst);
         status  = dst.getStatus();
-        if (global::doDraw) dst.draw();
+        if (global::doDraw) DebugSink::instance().show(dst, global::image, "boardAfterColumnExpansion");
         if (status.second <= 0)
             addColumns = false;
     }
+}
 
-    //const Square& square = possibleBoard.getRef(0);
-    //bool check = square.containsPoint(cv::Point2d(200,200));
-    return true;
+namespace {
+
+// Counts of one square type over rectangles of the candidate grid in O(1), a view of one of
+// the summed-area tables of Board::getTypeSums()
+class TypeCounts
+{
+public:
+    TypeCounts(const int* sums_, int rows_, int cols_) : rows(rows_), cols(cols_), sums(sums_) {}
+
+    // Squares of the type in rows [r1, r2) and columns [c1, c2), clipped to the grid
+    int count(int r1, int c1, int r2, int c2) const {
+        r1 = std::max(r1, 0); c1 = std::max(c1, 0);
+        r2 = std::min(r2, rows); c2 = std::min(c2, cols);
+        if (r1 >= r2 || c1 >= c2)
+            return 0;
+        return sums[r2 * (cols + 1) + c2] - sums[r1 * (cols + 1) + c2] - sums[r2 * (cols + 1) + c1] + sums[r1 * (cols + 1) + c1];
+    }
+
+private:
+    int rows, cols;
+    const int* sums;
+};
+
+} // end anonymous namespace
+
+BoardDetector::BoardWindow BoardDetector::findBoardWindow(const Board& board)
+{
+    const int N = BoardIndex::rows;
+    const int M = BoardIndex::cols;
+    int rows = board.getNumRows();
+    int cols = board.getNumCols();
+
+    const std::vector<int>& sums = board.getTypeSums();
+    size_t plane = (rows + 1) * (cols + 1);
+    TypeCounts inner(&sums[0], rows, cols), border(&sums[plane], rows, cols), corner(&sums[2 * plane], rows, cols);
+
+    // A window may hang over the grid where the grid is smaller than the board, the squares
+    // it misses score nothing and are added by expanding the board
+    BoardWindow best;
+    best.row = best.col = 0;
+    best.score = best.runnerUp = -1;
+    for (int r0 = std::min(0, rows - N); r0 <= std::max(0, rows - N); r0++){
+        for (int c0 = std::min(0, cols - M); c0 <= std::max(0, cols - M); c0++){
+            int r1 = r0 + N - 1, c1 = c0 + M - 1; // last row and column of the window
+            int score = inner.count(r0 + 1, c0 + 1, r1, c1)
+                      + border.count(r0, c0 + 1, r0 + 1, c1) + border.count(r1, c0 + 1, r1 + 1, c1)
+                      + border.count(r0 + 1, c0, r1, c0 + 1) + border.count(r0 + 1, c1, r1, c1 + 1)
+                      + corner.count(r0, c0, r0 + 1, c0 + 1) + corner.count(r0, c1, r0 + 1, c1 + 1)
+                      + corner.count(r1, c0, r1 + 1, c0 + 1) + corner.count(r1, c1, r1 + 1, c1 + 1);
+            if (score > best.score){
+                best.runnerUp = best.score;
+                best.score = score;
+                best.row = r0;
+                best.col = c0;
+            } else if (score > best.runnerUp){
+                best.runnerUp = score;
+            }
+        }
+    }
+    best.runnerUp = std::max(best.runnerUp, 0); // a single window has no competitor
+    return best;
+}
+
+void BoardDetector::fitBoardWindow(Board& dst)
+{
+    dst.classifySquares();
+    window = findBoardWindow(dst);
+    LOG_INFO("Board window at row " << window.row << ", col " << window.col << " matches " << window.score << " of "
+             << BoardIndex::nSquares << " square types, runner-up " << window.runnerUp);
+
+    report.expansions += dst.cropToWindow(window.row, window.col);
 }
 
 void BoardDetector::writeHoughAfterCategorizationToGlobal()
@@ -182,107 +388,136 @@ void BoardDetector::writeHoughAfterCategorizationToGlobal()
 }
 
 void BoardDetector::categorizeLines(){
-    for (size_t i=0; i<lines.size();i++)
-    {
-        if (lines[i].slope < 0.1 && lines[i].slope > -0.1) // TODO: make numbers dynamic based on iamge size!
-        {
-            hlinesIdx.push_back((int) i);
+    // Histogram of segment angles in [0,180), weighted by segment length
+    const int nBins = 180;
+    std::vector<double> angles(lines.size());
+    std::vector<double> histogram(nBins, 0);
+    for (size_t i = 0; i < lines.size(); i++){
+        angles[i] = lineAngle(lines[i]);
+        histogram[(int) angles[i] % nBins] += lineLength(lines[i]);
+    }
+
+    // Smooth circularly so a cluster spread over neighbouring bins gives a single peak
+    std::vector<double> smoothed(nBins, 0);
+    for (int bin = 0; bin < nBins; bin++){
+        for (int k = -2; k <= 2; k++){
+            smoothed[bin] += histogram[(bin + k + nBins) % nBins];
         }
-        else
-        {
-            vlinesIdx.push_back((int) i);
-        }
-    }
-
-    /////////// H O R I Z O N T A L   L I N E S ///////////
-    // Sort horizontal lines
-    std::vector<std::pair<int,double> > yints(hlinesIdx.size());
-
-    std::pair<int,double> p;
-    for (size_t i = 0; i < hlinesIdx.size(); ++i) {
-        Line line = lines[hlinesIdx[i]];
-        p.first = (int) i;
-        p.second = (double) line.yIntercept;
-        yints[i] = p;
     }
 
-    std::sort(yints.begin(), yints.end(), cvutils::pairIsLess);
-
-    // Remove duplicate horizontal lines
-    std::vector<int> removeIdx1(yints.size(), 0);
-    for (size_t i = 1; i < yints.size(); ++i) {
-        double yint1 = yints[i-1].second;
-        double yint2 = yints[i].second;
-        double diff =  abs(yint1 - yint2);
-        if (diff < 10)
-            removeIdx1[i] = 1;
+    // The two dominant directions
+    int peak1 = std::max_element(smoothed.begin(), smoothed.end()) - smoothed.begin();
+    int peak2 = -1;
+    for (int bin = 0; bin < nBins; bin++){
+        if (angleDistance(bin, peak1) < settings.minClusterSeparation)
+            continue;
+        if (peak2 < 0 || smoothed[bin] > smoothed[peak2])
+            peak2 = bin;
+    }
+    if (peak2 < 0)
+        peak2 = (peak1 + 90) % nBins;
+
+    // The direction closest to 0 degrees is the horizontal one
+    double hAngle = peak1 + 0.5;
+    double vAngle = peak2 + 0.5;
+    if (angleDistance(hAngle, 0) > angleDistance(vAngle, 0))
+        std::swap(hAngle, vAngle);
+
+    for (size_t i = 0; i < lines.size(); i++){
+        double hdist = angleDistance(angles[i], hAngle);
+        double vdist = angleDistance(angles[i], vAngle);
+        if (std::min(hdist, vdist) > settings.maxClusterDeviation)
+            continue;
+        if (hdist <= vdist)
+            hlinesIdx.push_back((int) i);
         else
-            removeIdx1[i] = 0;
-    }
-
-    // remove false horizontal lines
-    std::vector<double> slopes(hlinesIdx.size());
-    for (size_t i = 0; i < hlinesIdx.size(); i++){
-        slopes[i] = lines[hlinesIdx[i]].slope;
+            vlinesIdx.push_back((int) i);
     }
-    double meanNoOutliers = cvutils::meanNoOutliers(slopes);
-    double tolerance = meanNoOutliers * 0.1;
-    // Add sorted unique horizontal lines to field
-    for (size_t i = 0; i < hlinesIdx.size(); ++i) {
 
-        if (removeIdx1[i] == 0){
-            Line line = lines.at(hlinesIdx[yints[i].first]);
-            //if (std::abs(line.slope - meanNoOutliers) <= tolerance)
-            hlinesSorted.push_back(line);
-        }
-    }
+    report.addLineCount("direction", lines.size(), hlinesIdx.size() + vlinesIdx.size());
 
-    /////////// V E R T I C A L   L I N E S ///////////
-    // Sort vertical lines
-    std::vector<std::pair<int,double> > xints(vlinesIdx.size());
+    hlinesSorted = sortUniqueLines(hlinesIdx, hAngle, true);
+    vlinesSorted = sortUniqueLines(vlinesIdx, vAngle, false);
+    report.addLineCount("unique", hlinesIdx.size() + vlinesIdx.size(), hlinesSorted.size() + vlinesSorted.size());
+    LOG_INFO("Line directions: " << hAngle << " and " << vAngle << " degrees, "
+             << hlinesSorted.size() << " horizontal and " << vlinesSorted.size() << " vertical lines");
 
-    std::pair<int,double> p2;
-    for (size_t i = 0; i < vlinesIdx.size(); ++i) {
-        Line line = lines[vlinesIdx[i]];
-        p2.first = (int) i;
-        p2.second = (double) line.xlookup(0, 1);
-        xints[i] = p2;
+    if (settings.refitLines && edges.data){
+        size_t before = hlinesSorted.size() + vlinesSorted.size();
+        refitLines(hlinesSorted, hAngle, true);
+        refitLines(vlinesSorted, vAngle, false);
+        report.addLineCount("refit", before, hlinesSorted.size() + vlinesSorted.size());
     }
 
-    std::sort(xints.begin(), xints.end(), cvutils::pairIsLess);
-
+    // vanishing point
 
+    Lines newVlines = filterBasedOnVanishingPoint(vlinesSorted);
+    report.addLineCount("vanishingPoint", hlinesSorted.size() + vlinesSorted.size(), hlinesSorted.size() + newVlines.size());
 
-    // Remove duplicate vertical lines
-    std::vector<int> removeIdx2(xints.size());
-    for (size_t i = 1; i < xints.size(); ++i) {
-        double xint1 = xints[i-1].second;
-        double xint2 = xints[i].second;
-        double diff =  abs(xint1 - xint2);
-        if (diff < 10)
-            removeIdx2[i] = 1;
-        else
-            removeIdx2[i] = 0;
-    }
+    vlinesSorted = newVlines;
 
+    writeHoughAfterCategorizationToGlobal();
+}
 
-    // Add sorted unique vertical lines to field
-    for (size_t i = 0; i < vlinesIdx.size(); i++) {
-        if (removeIdx2[i] == 0){
-            int idx1 = xints[i].first;
-            int idx2 = vlinesIdx[idx1];
-            Line line = lines.at(idx2);
-            vlinesSorted.push_back(line);
+Lines BoardDetector::sortUniqueLines(const std::vector<int>& idx, double angle, bool horizontal)
+{
+    Offsets offsets = sortedOffsets(lines, idx, angle, horizontal);
+    Lines sorted;
+    if (offsets.empty())
+        return sorted;
+
+    double tolerance = duplicateTolerance(offsets, settings.minDuplicateDistance, settings.duplicateFraction);
+    double last = offsets[0].second;
+    sorted.push_back(lines[offsets[0].first]);
+    for (size_t i = 1; i < offsets.size(); i++){
+        if (offsets[i].second - last >= tolerance){
+            sorted.push_back(lines[offsets[i].first]);
+            last = offsets[i].second;
         }
     }
+    return sorted;
+}
 
-    // vanishing point
-
-    Lines newVlines = filterBasedOnVanishingPoint(vlinesSorted);
-
-    vlinesSorted = newVlines;
+void BoardDetector::refitLines(Lines& sorted, double angle, bool horizontal)
+{
+    if (sorted.empty())
+        return;
+
+    std::vector<int> support(sorted.size());
+    std::vector<int> idx(sorted.size());
+    for (size_t i = 0; i < sorted.size(); i++){
+        support[i] = sorted[i].fitToEdges(edges, settings.refitBand);
+        idx[i] = (int) i;
+    }
+
+    // refitting may swap neighbours, sort again
+    Offsets offsets = sortedOffsets(sorted, idx, angle, horizontal);
+    Lines merged;
+    if (offsets.empty()){
+        sorted = merged;
+        return;
+    }
+
+    // duplicates converge onto the same edge, keep the one with most support.
+    // Groups are measured from their first line so merges do not chain across the lattice.
+    double tolerance = duplicateTolerance(offsets, settings.minDuplicateDistance, settings.duplicateFraction);
+    double first = offsets[0].second;
+    int keep = offsets[0].first;
+    for (size_t i = 1; i < offsets.size(); i++){
+        int current = offsets[i].first;
+        if (offsets[i].second - first < tolerance){
+            if (support[current] > support[keep])
+                keep = current;
+        } else {
+            merged.push_back(sorted[keep]);
+            keep = current;
+            first = offsets[i].second;
+        }
+    }
+    merged.push_back(sorted[keep]);
 
-    writeHoughAfterCategorizationToGlobal();
+    LOG_DEBUG("Refitted lines to edge pixels, reduced from " << sorted.size() << " to " << merged.size());
+    sorted = merged;
 }
 
 Lines BoardDetector::filterBasedOnVanishingPoint(Lines vlines){
@@ -331,7 +566,7 @@ Lines BoardDetector::filterBasedOnVanishingPoint(Lines vlines){
         }
     }
     xvpoint = cv::mean(voters)[0];
-    std::cout << "vanishing point" << xvpoint << std::endl;
+    LOG_DEBUG("vanishing point" << xvpoint);
 
     // find the pair of lines that voted closest to the mean
     cv::Vec3i winnerPair;
@@ -380,7 +615,7 @@ Lines BoardDetector::filterBasedOnVanishingPoint(Lines vlines){
         }
     }
 
-    std::cout << "Reduced vertical lines from " << vlines.size() << " to " << newVlines.size() << std::endl;
+    LOG_DEBUG("Reduced vertical lines from " << vlines.size() << " to " << newVlines.size());
      return newVlines;
 
 }
@@ -393,38 +628,40 @@ void BoardDetector::filterBasedOnSquareSize(Board &board, Remover &remover)
     std::vector<int> hlengths(nCols);
     std::vector<int> vlengths(nRows);
 
-    std::cout << "FILTER BASED ON SQUARE SIZE" << std::endl;
+    LOG_DEBUG("FILTER BASED ON SQUARE SIZE");
+
+    size_t filter = remover.addFilter("square size");
 
     // Flag outliers based on horizontal lengths
     std::vector<size_t> houtliers(nCols,0);
     for (size_t row = 0; row < nRows; row++){
-        std::cout << "ROW " << row << std::endl;
-        Squares squares = board.getRow(row);
-        for (size_t col = 0; col < squares.size(); col++){
-            hlengths.at(col) = squares.at(col).getHLength();
-            std::cout << "hlengths.at(" <<col<<"):\t" <<hlengths.at(col) << std::endl;
+        LOG_TRACE("ROW " << row);
+        StridedView<const Square> squares = board.rowView(row);
+        for (size_t col = 0; col < nCols; col++){
+            hlengths.at(col) = squares[col].getHLength();
+            LOG_TRACE("hlengths.at(" <<col<<"):\t" <<hlengths.at(col));
         }
         houtliers = cvutils::flagOutliers(hlengths);
-        remover.addToRow(row, houtliers);
+        remover.voteRow(filter, row, houtliers);
     }
 
     // Flag outliers based on vertical lengths
     for (size_t col = 0; col < board.getNumCols(); col++){
-        std::cout << "COL " << col << std::endl;
-        Squares squares = board.getCol(col);
-        for (size_t row = 0; row < squares.size(); row++){
-            vlengths.at(row) = squares.at(row).getVLength();
-            std::cout << "vlengths.at(" << row << "):\t" << vlengths.at(row) << std::endl;
+        LOG_TRACE("COL " << col);
+        StridedView<const Square> squares = board.colView(col);
+        for (size_t row = 0; row < nRows; row++){
+            vlengths.at(row) = squares[row].getVLength();
+            LOG_TRACE("vlengths.at(" << row << "):\t" << vlengths.at(row));
         }
 
         //double midmean = cvutils::meanNoOutliers(vlengths);
         Regression<int> reg(vlengths);
         std::vector<double> errors = reg.squaredErrors();
         double meanerror = cv::mean(errors)[0];
-        for (size_t row = 0; row < squares.size(); row++){
+        for (size_t row = 0; row < nRows; row++){
             bool doVote = errors.at(row) > meanerror;
             if (doVote)
-                remover.addToElement(row, col, 1);
+                remover.vote(filter, row, col);
         }
     }
 }
@@ -433,11 +670,11 @@ void BoardDetector::filterBasedOnRowType(Board& board, Remover& remover)
 {
     std::vector<int> types = board.getRowTypes();
 
-    std::vector<size_t> votes(board.getNumCols());
-    std::for_each(votes.begin(), votes.end(), [](size_t& v){v = 1;});
+    size_t filter = remover.addFilter("row type");
+    std::vector<size_t> votes(board.getNumCols(), 1);
     for (size_t row = 0; row < types.size(); row++){
         if (types.at(row) == 0){
-            remover.addToRow(row, votes);
+            remover.voteRow(filter, row, votes);
         }
     }
 }
@@ -446,49 +683,47 @@ void BoardDetector::filterBasedOnColType(Board& board, Remover& remover)
 {
     std::vector<int> types = board.getColTypes();
 
-    std::vector<size_t> votes(board.getNumRows());
-    std::for_each(votes.begin(), votes.end(), [](size_t& v){v = 1;});
+    size_t filter = remover.addFilter("column type");
+    std::vector<size_t> votes(board.getNumRows(), 1);
     for (size_t col = 0; col < types.size(); col++){
         if (types.at(col) == 0){
-            remover.addToCol(col, votes);
+            remover.voteCol(filter, col, votes);
         }
     }
 }
 
 void BoardDetector::requestColumnExpansion(Board& board)
 {
-    Squares left = board.getCol(0);
-    Squares right = board.getCol(board.getNumCols()-1);
-
-    std::vector<int> leftTypes = Square::getSquareTypes(left);
-    std::vector<int> rightTypes = Square::getSquareTypes(right);
-
-    int sumLeft = cv::sum(leftTypes)[0];
-    int sumRight = cv::sum(rightTypes)[0];
+    int sumLeft = 0;
+    int sumRight = 0;
+    for (const Square& square : board.colView(0))
+        sumLeft += square.getSquareType();
+    for (const Square& square : board.colView(board.getNumCols()-1))
+        sumRight += square.getSquareType();
 
     Direction dir = LEFT;
     if (sumLeft < sumRight)
         dir = RIGHT;
 
     board.expand(dir);
+    report.expansions++;
 }
 
 void BoardDetector::requestRowExpansion(Board &board)
 {
-    Squares top = board.getRow(0);
-    Squares bottom = board.getRow(board.getNumRows()-1);
-
-    std::vector<int> topTypes = Square::getSquareTypes(top);
-    std::vector<int> bottomTypes = Square::getSquareTypes(bottom);
-
-    int sumTop = cv::sum(topTypes)[0];
-    int sumBottom = cv::sum(bottomTypes)[0];
+    int sumTop = 0;
+    int sumBottom = 0;
+    for (const Square& square : board.rowView(0))
+        sumTop += square.getSquareType();
+    for (const Square& square : board.rowView(board.getNumRows()-1))
+        sumBottom += square.getSquareType();
 
     Direction dir = UP;
     if (sumTop < sumBottom)
         dir = DOWN;
 
     board.expand(dir);
+    report.expansions++;
 }
 
 
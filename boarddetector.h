@@ -3,36 +3,52 @@
 
 #include <vector>
 #include <string>
-#include "Line.h"
+#include "line.h"
 #include "cvutils.h"
 #include "corner.h"
 #include "typedefs.h"
 #include "board.h"
 #include "remover.h"
 #include "report.h"
+#include "settings.h"
 
 class BoardDetector
 {
 public:
     ~BoardDetector();
-    BoardDetector(std::vector<Line>);
+    BoardDetector(std::vector<Line>, Settings::BoardSettings settings = Settings::BoardSettings(), cv::Mat edges = cv::Mat());
 
     Lines get_hlinesSorted();
     Lines get_vlinesSorted();
     Corners getCorners();
 
+    // 8x8 window of the candidate grid that matches the square types of a board best. row and
+    // col of its upper left square are negative when the grid misses rows or columns before it.
+    struct BoardWindow {int row, col, score, runnerUp;};
+
     bool detect(Board &dst, std::string *reportPath = 0);
     void writeHoughAfterCategorizationToGlobal();
+    static BoardWindow findBoardWindow(const Board& board);
+    const BoardWindow& getBoardWindow() const {return window;} // of the last detect with windowSearch
+    const Report& getReport() const {return report;} // of this detector's lines and its last detect
 private:
+    Settings::BoardSettings settings;
+    BoardWindow window;
+    Report report;
     bool boardInitialized;
     void categorizeLines();
+    Lines sortUniqueLines(const std::vector<int>& idx, double angle, bool horizontal);
     Lines filterBasedOnVanishingPoint(Lines vlines);
+    void refitLines(Lines& sorted, double angle, bool horizontal);
     void filterBasedOnSquareSize(Board& Board, Remover& remover);
     void filterBasedOnRowType(Board& Board, Remover& remover);
     void filterBasedOnColType(Board& Board, Remover& remover);
     void requestColumnExpansion(Board &board);
     void requestRowExpansion(Board& board);
+    void pruneAndExpand(Board& dst, std::string *reportPath);
+    void fitBoardWindow(Board& dst);
 
+    cv::Mat edges;
     std::vector<Line> lines;
     std::vector<double> slopes;
     int xvpoint;
@@ -0,0 +1,57 @@
+#include <stdexcept>
+#include "boardrectifier.h"
+
+BoardRectifier::BoardRectifier(const Board& board, int tileSize_)
+{
+    if (tileSize_ < 1){
+        throw std::invalid_argument("Tile size must be positive");
+    }
+    nRows = board.getNumRows();
+    nCols = board.getNumCols();
+    tileSize = tileSize_;
+
+    cv::Mat gridToImage;
+    if (!board.getHomography(gridToImage)){
+        throw std::invalid_argument("Board has no homography, can't rectify");
+    }
+
+    // grid coordinates of the center of every output pixel, mapped into the image
+    int width = (int) nCols * tileSize;
+    int height = (int) nRows * tileSize;
+    cv::Mat grid(height, width, CV_32FC2);
+    for (int v = 0; v < height; v++){
+        cv::Vec2f* row = grid.ptr<cv::Vec2f>(v);
+        for (int u = 0; u < width; u++){
+            row[u] = cv::Vec2f((u + 0.5f) / tileSize, (v + 0.5f) / tileSize);
+        }
+    }
+    cv::Mat map;
+    cv::perspectiveTransform(grid, map, gridToImage);
+    cv::convertMaps(map, cv::Mat(), map1, map2, CV_16SC2);
+}
+
+void BoardRectifier::rectify(const cv::Mat& image, cv::Mat& dst) const
+{
+    cv::remap(image, dst, map1, map2, cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+}
+
+cv::Rect BoardRectifier::getTileRect(size_t idx) const
+{
+    return cv::Rect((int) (idx % nCols) * tileSize, (int) (idx / nCols) * tileSize, tileSize, tileSize);
+}
+
+cv::Mat BoardRectifier::getTile(const cv::Mat& rectified, size_t idx) const
+{
+    return rectified(getTileRect(idx));
+}
+
+size_t BoardRectifier::tileAt(cv::Point2d point) const
+{
+    if (point.x < 0 || point.y < 0)
+        return getNumTiles();
+    size_t col = (size_t) (point.x / tileSize);
+    size_t row = (size_t) (point.y / tileSize);
+    if (row >= nRows || col >= nCols)
+        return getNumTiles();
+    return row * nCols + col;
+}
@@ -0,0 +1,28 @@
+#ifndef BOARDRECTIFIER_H
+#define BOARDRECTIFIER_H
+
+#include <opencv2/opencv.hpp>
+#include "board.h"
+
+// Warps the board into a top-down image where every square is a tileSize x tileSize tile,
+// tiles laid out row by row like the squares. The remap table is computed once from the
+// board homography, after that rectifying an image is a single cv::remap.
+class BoardRectifier
+{
+public:
+    BoardRectifier(const Board& board, int tileSize = 64);
+
+    void rectify(const cv::Mat& image, cv::Mat& dst) const;
+    cv::Mat getTile(const cv::Mat& rectified, size_t idx) const;
+    cv::Rect getTileRect(size_t idx) const;
+    size_t tileAt(cv::Point2d rectifiedPoint) const; // number of tiles if outside
+    int getTileSize() const {return tileSize;}
+    size_t getNumTiles() const {return nRows * nCols;}
+
+private:
+    size_t nRows, nCols;
+    int tileSize;
+    cv::Mat map1, map2; // fixed point remap table
+};
+
+#endif // BOARDRECTIFIER_H
@@ -1,22 +1,164 @@
 #include "corner.h"
 #include "cvutils.h"
 #include "typedefs.h"
+#include "log.h"
 #include <opencv2/opencv.hpp>
+#include <algorithm>
 #include <fstream>
 #include <string>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-Corner::Corner(){classified = false;}
+const int Corner::maxRadius;
+const int Corner::defaultRings;
 
-Corner::Corner(const cv::Mat& image, cv::Point2d cornerpoint, int radius)
+namespace {
+
+typedef unsigned long long Word;
+
+const int nSamples = 64; // samples per ring, one bit each in a Word
+
+// Square rings around the corner, ring h runs through the pixels h steps out from the
+// center of the patch. Each ring is walked clockwise from its upper left pixel and
+// sampled at nSamples evenly spaced positions, so every ring costs the same whatever
+// its radius. Offsets are relative to the patch center.
+class RingTables
+{
+public:
+    RingTables(){
+        for (int h = 1; h <= Corner::maxRadius; h++){
+            int side = 2 * h - 1;
+            int n = 4 * side;
+            for (int j = 0; j < nSamples; j++){
+                int pos = (j * n) / nSamples;
+                int t = pos % side;
+                int x, y;
+                switch (pos / side){
+                case 0: x = t; y = 0; break;                // upper left to upper right
+                case 1: x = side; y = t; break;             // upper right to lower right
+                case 2: x = side - t; y = side; break;      // lower right to lower left
+                default: x = 0; y = side - t; break;        // lower left to upper left
+                }
+                dx[h][j] = (signed char) (x - h);
+                dy[h][j] = (signed char) (y - h);
+            }
+        }
+    }
+
+    signed char dx[Corner::maxRadius + 1][nSamples];
+    signed char dy[Corner::maxRadius + 1][nSamples];
+};
+
+const RingTables& ringTables(){
+    static const RingTables tables; // built on first use, initialisation is thread safe
+    return tables;
+}
+
+inline int lowestBit(Word w){
+#if defined(__GNUC__)
+    return __builtin_ctzll(w);
+#else
+    int idx = 0;
+    while (!(w & 1)){
+        w >>= 1;
+        idx++;
+    }
+    return idx;
+#endif
+}
+
+// Packs ring[j] >= threshold into bit j
+inline Word binarize(const uchar* ring, int threshold){
+    Word bits = 0;
+#if defined(__SSE2__)
+    __m128i t = _mm_set1_epi8((char) threshold);
+    for (int j = 0; j < nSamples; j += 16){
+        __m128i v = _mm_loadu_si128((const __m128i*) (ring + j));
+        __m128i ge = _mm_cmpeq_epi8(_mm_max_epu8(v, t), v);
+        bits |= (Word) (_mm_movemask_epi8(ge) & 0xFFFF) << j;
+    }
+#else
+    for (int j = 0; j < nSamples; j++){
+        if (ring[j] >= threshold)
+            bits |= (Word) 1 << j;
+    }
+#endif
+    return bits;
+}
+
+// Number of colour changes around a ring, after runs shorter than minRun have been
+// absorbed by their neighbours
+inline int countRegions(Word bits, int minRun){
+    // bit j is set where a run starts, i.e. where bit j differs from bit j-1 (circularly)
+    Word starts = bits ^ ((bits << 1) | (bits >> (nSamples - 1)));
+
+    int runStart[nSamples];
+    int nRuns = 0;
+    while (starts){
+        runStart[nRuns++] = lowestBit(starts);
+        starts &= starts - 1;
+    }
+    if (nRuns < 2)
+        return 0; // uniform ring
+
+    int regions = 0;
+    int firstColour = -1;
+    int previousColour = -1;
+    for (int m = 0; m < nRuns; m++){
+        int end = (m + 1 < nRuns) ? runStart[m+1] : runStart[0] + nSamples;
+        if (end - runStart[m] < minRun)
+            continue;
+        int colour = (int) ((bits >> runStart[m]) & 1);
+        if (firstColour < 0)
+            firstColour = colour;
+        else if (colour != previousColour)
+            regions++;
+        previousColour = colour;
+    }
+    if (firstColour >= 0 && previousColour != firstColour)
+        regions++;
+    return regions;
+}
+
+// Copies the samples of ring h into dst and returns their sum
+inline int gatherRing(const cv::Mat& area, int radius, int h, uchar* dst){
+    const RingTables& tables = ringTables();
+    const signed char* dx = tables.dx[h];
+    const signed char* dy = tables.dy[h];
+    const uchar* center = area.data + radius * area.step + radius;
+    int step = (int) area.step;
+    int sum = 0;
+    for (int j = 0; j < nSamples; j++){
+        uchar v = center[dy[j] * step + dx[j]];
+        dst[j] = v;
+        sum += v;
+    }
+    return sum;
+}
+
+} // end anonymous namespace
+
+Corner::Corner(){classified = false; outOfBounds = true; nRegions = 0; radius = 0; nRings = defaultRings;}
+
+Corner::Corner(const cv::Mat& image, cv::Point2d cornerpoint, int radius, int nRings)
 {
     if (!global::image.data){
         throw std::invalid_argument("global::image is empty, cannot create corner");
     }
+    if (radius > maxRadius){
+        throw std::invalid_argument("Corner radius can be at most " + std::to_string(maxRadius));
+    }
+    if (nRings < 1){
+        throw std::invalid_argument("A corner needs at least one ring");
+    }
     classified = false;
+    nRegions = 0;
 
     this->initialCornerpoint = cornerpoint;
     this->cornerpoint = cornerpoint;
     this->radius = radius;
+    this->nRings = nRings;
 
     // Create area around cornerpoint
     int x = (int) cornerpoint.x - radius;
@@ -31,20 +173,27 @@ Corner::Corner(const cv::Mat& image, cv::Point2d cornerpoint, int radius)
     }
     catch (std::exception& e){
         outOfBounds = true;
-        std::cout << "Corner is too close to global::image border" << std::endl;
+        LOG_DEBUG("Corner is too close to global::image border");
     }
-    //recalculateCornerpoint(); //TODO
 
     if (!outOfBounds)
         classify(); // set nRegions;
 }
 
+bool Corner::isOutOfBounds(const cv::Mat& image, cv::Point2d cornerpoint, int radius)
+{
+    // same patch as the constructor cuts out
+    int x = (int) cornerpoint.x - radius;
+    int y = (int) cornerpoint.y - radius;
+    return x < 0 || y < 0 || x + 2 * radius > image.cols || y + 2 * radius > image.rows;
+}
+
 cv::Mat Corner::getArea()
 {
     return area;
 }
 
-int Corner::getNRegions()
+int Corner::getNRegions() const
 {
     return nRegions;
 }
@@ -52,134 +201,74 @@ int Corner::getNRegions()
 void Corner::classify(){
     if (outOfBounds)
         return;
-    int nc = area.cols;
-    int nr = area.rows;
-
-    int nLayers = std::min(nc, nr) / 2 - 1;
-    std::vector<Points2d> layercorners(nLayers);
 
-    // Determine coordinates of corners in each layer
-    for (int i = 0; i < nLayers; i++) {
-        cv::Point2d upperleft = cv::Point2d(i, i);
-        cv::Point2d upperright = cv::Point2d(nc-1-i, i);
-        cv::Point2d lowerright = cv::Point2d(nc-1-i, nr-1-i);
-        cv::Point2d lowerleft = cv::Point2d(i, nr-1-i);
-
-
-        Points2d points{upperleft, upperright, lowerright, lowerleft};
-
-        layercorners[i] = points;
+    // Each ring is sampled through a precomputed offset table into a stack buffer, binarized
+    // into a single 64 bit mask and its regions counted with bit operations. The cost is
+    // nRings * nSamples pixels whatever the radius, and there are no heap allocations.
+    int nRingsConsulted = getNRingsConsulted();
+
+    uchar ring[nSamples];
+    int histogram[6] = {0, 0, 0, 0, 0, 0}; // votes can be 0 (undetermined), 1, 2, 3, 4, or 5 (more than 4)
+    for (int k = 0; k < nRingsConsulted; ++k) {
+        int sum = gatherRing(area, radius, getRingRadius(k), ring);
+        Word bits = binarize(ring, sum / nSamples);
+        int regions = countRegions(bits, nSamples / 8);
+        ++histogram[std::min(5, regions)]; // Only care about the fact that it is more than 4.
     }
 
-    for (int i = 0; i < nLayers; i++)
-    {
-        int n = 2 * (nc-1-i*2) + 2 * (nr-1-i*2); // number of pixels in layer
-        std::vector<int> layer(n);
-
-        Points2d corners = layercorners[i];
-
-        // upper left corner to upper right corner
-        int row = corners[0].y;
-        int col = corners[0].x;
-        int idx = 0;
-        while (col < corners[1].x)
-        {
-            layer[idx] = (int) area.at<uchar>(col, row);
-            col++;
-            idx++;
-        }
-
-        // upper right corner to lower right corner
-        while (row < corners[2].y)
-        {
-            layer[idx] = (int) area.at<uchar>(col, row);
-            row++;
-            idx++;
-        }
-
-        // lower right corner to lower left corner
-        while (col > corners[3].x)
-        {
-            layer[idx] = (int) area.at<uchar>(col, row);
-            col--;
-            idx++;
-        }
-
-        // lower left corner to upper left corner
-        while (row > corners[0].y)
-        {
-            layer[idx] = (int) area.at<uchar>(col, row);
-            row--;
-            idx++;
-        }
-
-        layers.push_back(layer);
+    nRegions = 0;
+    if (nRingsConsulted > 0){
+        int vote = std::max_element(histogram, histogram + 6) - histogram;
+        double pct = histogram[vote] / (double) nRingsConsulted;
+        if (pct > 0.7)
+            nRegions = vote;
     }
 
-    // binarize
-    for (size_t i = 0; i < layers.size(); ++i) {
-        std::vector<int> grayLayer = layers[i];
-        std::vector<int> binLayer(grayLayer.size());
-        int meancol = (int) cv::mean(grayLayer)[0];
-        for (size_t j = 0; j < grayLayer.size(); j++) {
-            if (grayLayer[j] < meancol){
-                binLayer[j] = 0;
-            } else {
-                binLayer[j] = 1;
-            }
-        }
-        binaryLayers.push_back(binLayer);
-    }
+    classified = true;
+}
 
-    // vote
-    double nLayersConsulted = binaryLayers.size() / 2; // many corners arent centered precisely on the intersection so the innermost layers dont traverse all four regions
-    std::vector<int> nRegionsVotes(nLayersConsulted);
-    for (size_t i = 0; i < nLayersConsulted; ++i) {
-        std::vector<int> dilated = binaryLayers[i];
-        cvutils::dilate(dilated);
-        int sumderiv = cvutils::sumderiv(dilated);
-        if (dilated[0] != dilated[dilated.size()-1]) // unlikely case that the layer is started right on the edge of a region
-            sumderiv++;
-        nRegionsVotes[i] = std::min(5,sumderiv); // if more than 4 regions found, set to 5. Only care about the fact that it is more than 4.
-    }
+int Corner::getNRingsConsulted() const
+{
+    // many corners arent centered precisely on the intersection so the inner half of the
+    // patch doesnt traverse all four regions
+    int available = (radius - 1) / 2;
+    return std::min(nRings, available);
+}
 
-    std::vector<int> histogram(5,0);
-    for( int i=0; i< (int) nRegionsVotes.size(); ++i )
-        ++histogram[ nRegionsVotes[i] ];
+int Corner::getRingRadius(int k) const
+{
+    // spread the rings evenly over the outer half of the patch
+    int available = (radius - 1) / 2;
+    return radius - (k * available) / getNRingsConsulted();
+}
 
-    int vote = std::max_element( histogram.begin(), histogram.end() ) - histogram.begin();
+std::vector<std::vector<int>> Corner::getLayers() const
+{
+    std::vector<std::vector<int>> layers;
+    if (outOfBounds)
+        return layers;
 
-    int count = 0;
-    for (size_t i = 0; i < binaryLayers.size(); ++i) {
-        if (nRegionsVotes[i] == vote)
-            count++;
+    uchar ring[nSamples];
+    for (int k = 0; k < getNRingsConsulted(); k++){
+        gatherRing(area, radius, getRingRadius(k), ring);
+        layers.push_back(std::vector<int>(ring, ring + nSamples));
     }
-
-    double pct = count / (double) nLayersConsulted;
-    if (pct > 0.7)
-        nRegions = vote;
-    else
-        nRegions = 0;
-
-    classified = true;
+    return layers;
 }
 
-void Corner::recalculateCornerpoint()
-{ // TODO look at: http://stackoverflow.com/questions/4292249/automatic-calculation-of-low-and-high-thresholds-for-the-canny-operation-in-open
-    int meancol =  (int) cv::mean(area)[0];
-    cv::Mat binArea = area;
-    //cv::threshold(area, binArea, 200, 255, 1);
-    //cv::GaussianBlur(area, binArea, cv::Size(1,1), 1);
-    cv::Canny(binArea, binArea, 30, 200, 3);
-    std::vector<cv::Vec4i> houghlines;
-    cv::HoughLinesP(binArea, houghlines, 1, CV_PI/180, 10);
-
-    for( size_t i = 0; i < houghlines.size(); i++ )
-        {
-            cv::line(binArea, cv::Point2d(houghlines[i][0], houghlines[i][1]),
-
-
-                cv::Point2d(houghlines[i][2], houghlines[i][3]), cv::Scalar(0,255,0), 10, 8 );
+std::vector<std::vector<int>> Corner::getBinaryLayers() const
+{
+    std::vector<std::vector<int>> binaryLayers = getLayers();
+    for (size_t i = 0; i < binaryLayers.size(); i++){
+        std::vector<int>& layer = binaryLayers[i];
+        int meancol = 0;
+        for (size_t j = 0; j < layer.size(); j++){
+            meancol += layer[j];
         }
-
+        meancol /= (int) layer.size();
+        for (size_t j = 0; j < layer.size(); j++){
+            layer[j] = layer[j] < meancol ? 0 : 1;
+        }
+    }
+    return binaryLayers;
 }
@@ -3,7 +3,7 @@
 
 #include <opencv2/opencv.hpp>
 #include "typedefs.h"
-#include "Line.h"
+#include "line.h"
 
 
 class Corner
@@ -11,13 +11,18 @@ class Corner
 
 public:
     Corner();
-    Corner(const cv::Mat&, cv::Point2d, int);
+    Corner(const cv::Mat&, cv::Point2d, int radius, int nRings = defaultRings);
     cv::Mat getArea();
-    int getNRegions();
-    bool isOutOfBounds(){return outOfBounds;}
+    int getNRegions() const;
+    bool isOutOfBounds() const {return outOfBounds;}
+    static bool isOutOfBounds(const cv::Mat& image, cv::Point2d cornerpoint, int radius); // without creating the corner
     static int cornernumber;
-    std::vector<std::vector<int>> getLayers(){return layers;}
-    std::vector<std::vector<int>> getBinaryLayers() {return binaryLayers;}
+    static const int maxRadius = 32;
+    static const int defaultRings = 4;
+
+    // Samples of the rings that are voted on, gathered on demand for reports
+    std::vector<std::vector<int>> getLayers() const;
+    std::vector<std::vector<int>> getBinaryLayers() const;
 
 private:
 
@@ -25,13 +30,13 @@ private:
     cv::Point2d initialCornerpoint;
     cv::Point2d cornerpoint;
     int radius;
+    int nRings;
     int nRegions;
-    std::vector<std::vector<int>> layers;
-    std::vector<std::vector<int>> binaryLayers;
     bool classified;
     bool outOfBounds;
     void classify();
-    void recalculateCornerpoint();
+    int getNRingsConsulted() const;
+    int getRingRadius(int k) const;
 };
 
 #endif // CORNER_H
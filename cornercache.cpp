@@ -0,0 +1,156 @@
+#include <algorithm>
+#include "cornercache.h"
+
+CornerCache::CornerCache()
+{
+    hits = 0;
+    misses = 0;
+    duplicates = 0;
+    nRings = Corner::defaultRings;
+    for (size_t i = 0; i < nShards; i++){
+        shards[i].resizeTable(128);
+    }
+}
+
+unsigned long long CornerCache::key(cv::Point2d point, int radius)
+{
+    // Corner truncates the point when it cuts out its patch
+    unsigned long long x = (unsigned long long) (int) point.x & 0xFFFFFF;
+    unsigned long long y = (unsigned long long) (int) point.y & 0xFFFFFF;
+    unsigned long long r = (unsigned long long) radius & 0xFFFF;
+    return (r << 48) | (y << 24) | x;
+}
+
+size_t CornerCache::hash(unsigned long long key)
+{
+    // neighbouring corners differ in the low bits of x and y, mix them into all bits
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (size_t) key;
+}
+
+CornerCache::Slot* CornerCache::Shard::find(unsigned long long k, size_t h)
+{
+    size_t mask = table.size() - 1;
+    for (size_t i = h & mask; ; i = (i + 1) & mask){
+        if (table[i].corner == 0 || table[i].key == k)
+            return &table[i];
+    }
+}
+
+void CornerCache::Shard::resizeTable(size_t capacity)
+{
+    std::vector<Slot> old;
+    old.swap(table);
+    Slot empty = {0, 0};
+    table.assign(capacity, empty);
+    for (size_t i = 0; i < old.size(); i++){
+        if (old[i].corner != 0)
+            *find(old[i].key, hash(old[i].key)) = old[i];
+    }
+}
+
+Corner* CornerCache::Shard::insert(unsigned long long k, size_t h, const Corner& corner)
+{
+    if (2 * (nCorners + 1) > table.size())
+        resizeTable(2 * table.size());
+
+    size_t block = nCorners / blockSize;
+    if (block == blocks.size())
+        blocks.push_back(std::unique_ptr<Corner[]>(new Corner[blockSize]));
+
+    Corner* stored = &blocks[block][nCorners % blockSize];
+    *stored = corner;
+    nCorners++;
+
+    Slot* slot = find(k, h);
+    slot->key = k;
+    slot->corner = stored;
+    return stored;
+}
+
+void CornerCache::Shard::clear()
+{
+    Slot empty = {0, 0};
+    std::fill(table.begin(), table.end(), empty);
+    for (size_t i = 0; i < nCorners; i++){
+        blocks[i / blockSize][i % blockSize] = Corner(); // drop the patch of the old frame, keep the block
+    }
+    nCorners = 0;
+}
+
+const Corner& CornerCache::getCorner(const cv::Mat& image, cv::Point2d point, int radius)
+{
+    unsigned long long k = key(point, radius);
+    size_t h = hash(k);
+    Shard& shard = shardOf(h);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        Slot* slot = shard.find(k, h);
+        if (slot->corner != 0){
+            hits++;
+            return *slot->corner;
+        }
+    }
+
+    // classify without holding the lock. If another thread got there first its
+    // corner is kept, both are identical.
+    Corner corner(image, point, radius, nRings);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Slot* slot = shard.find(k, h);
+    if (slot->corner != 0){
+        duplicates++;
+        return *slot->corner;
+    }
+    misses++;
+    return *shard.insert(k, h, corner);
+}
+
+void CornerCache::clear()
+{
+    for (size_t i = 0; i < nShards; i++){
+        std::lock_guard<std::mutex> lock(shards[i].mutex);
+        shards[i].clear();
+    }
+    hits = 0;
+    misses = 0;
+    duplicates = 0;
+}
+
+void CornerCache::setRings(int nRings_)
+{
+    if (nRings_ == nRings)
+        return;
+    nRings = nRings_;
+    for (size_t i = 0; i < nShards; i++){
+        std::lock_guard<std::mutex> lock(shards[i].mutex);
+        shards[i].clear();
+    }
+}
+
+size_t CornerCache::getHits() const
+{
+    return hits;
+}
+
+size_t CornerCache::getMisses() const
+{
+    return misses;
+}
+
+size_t CornerCache::getDuplicates() const
+{
+    return duplicates;
+}
+
+size_t CornerCache::size() const
+{
+    size_t n = 0;
+    for (size_t i = 0; i < nShards; i++){
+        std::lock_guard<std::mutex> lock(shards[i].mutex);
+        n += shards[i].nCorners;
+    }
+    return n;
+}
@@ -0,0 +1,71 @@
+#ifndef CORNERCACHE_H
+#define CORNERCACHE_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "corner.h"
+
+// Neighbouring squares share their corners. The cache makes sure each physical
+// corner is extracted and classified once per frame. Corners are keyed by the
+// pixel their patch is centred on and the patch radius, so a hit gives exactly
+// the classification a new Corner would have computed.
+// The cache can be shared by threads classifying squares in parallel. It is split
+// into shards by key, each with its own lock, so threads working on different
+// corners rarely wait for each other.
+// Corners live in an arena of fixed size blocks and are found through an open
+// addressing table. clear() keeps both, so once the cache has seen a frame of a
+// given size the following frames do not allocate.
+class CornerCache
+{
+public:
+    CornerCache();
+
+    const Corner& getCorner(const cv::Mat& image, cv::Point2d point, int radius);
+    void clear(); // call when a new frame is processed
+    void setRings(int nRings); // rings the corners are classified with, clears the cache when it changes
+
+    size_t getHits() const;       // lookups answered from the cache
+    size_t getMisses() const;     // corners classified and kept
+    size_t getDuplicates() const; // corners classified by two threads at once, the second one is thrown away
+    size_t size() const;
+
+private:
+    struct Slot
+    {
+        unsigned long long key;
+        Corner* corner; // 0 when the slot is free
+    };
+    static const size_t blockSize = 256;
+    static const size_t shardBits = 4;
+    static const size_t nShards = 1 << shardBits;
+
+    struct Shard
+    {
+        Shard() : nCorners(0) {}
+
+        mutable std::mutex mutex;
+        std::vector<std::unique_ptr<Corner[]> > blocks; // corners are never moved, references stay valid until clear()
+        std::vector<Slot> table; // size is a power of two, at most half full
+        size_t nCorners;
+
+        Slot* find(unsigned long long key, size_t hash);
+        Corner* insert(unsigned long long key, size_t hash, const Corner& corner);
+        void resizeTable(size_t capacity);
+        void clear();
+    };
+
+    Shard shards[nShards];
+    std::atomic<size_t> hits;
+    std::atomic<size_t> misses;
+    std::atomic<size_t> duplicates;
+    std::atomic<int> nRings;
+
+    static unsigned long long key(cv::Point2d point, int radius);
+    static size_t hash(unsigned long long key);
+    Shard& shardOf(size_t hash){return shards[hash >> (8 * sizeof(size_t) - shardBits)];} // top bits pick the shard, low bits the slot
+};
+
+#endif // CORNERCACHE_H
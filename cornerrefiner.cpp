@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+#include "cornerrefiner.h"
+#include "log.h"
+
+namespace {
+
+class RefineBody : public cv::ParallelLoopBody
+{
+public:
+    RefineBody(const CornerRefiner& refiner_, Points2d& points_, std::atomic<size_t>& moved_)
+        : refiner(refiner_), points(points_), moved(moved_) {}
+
+    void operator()(const cv::Range& range) const {
+        size_t count = 0;
+        for (int i = range.start; i < range.end; i++){
+            count += refiner.refine(points[i]) ? 1 : 0;
+        }
+        moved += count;
+        logging::flush(); // pool threads are never joined
+    }
+
+private:
+    const CornerRefiner& refiner;
+    Points2d& points;
+    std::atomic<size_t>& moved;
+};
+
+} // end anonymous namespace
+
+CornerRefiner::CornerRefiner(const cv::Mat& image_, int radius_, int maxIterations_)
+{
+    if (radius_ < 2){
+        throw std::invalid_argument("Refinement radius must be at least 2");
+    }
+
+    setImage(image_);
+    radius = radius_;
+    maxIterations = maxIterations_;
+    windowSize = 2 * radius + 1;
+
+    calcPseudoInverse();
+}
+
+void CornerRefiner::setImage(const cv::Mat& image_)
+{
+    if (image_.empty()){
+        throw std::invalid_argument("Cannot refine corners on an empty image");
+    }
+    if (image_.type() != CV_8UC1){
+        throw std::invalid_argument("Corner refinement needs a grayscale image");
+    }
+    image = image_;
+}
+
+void CornerRefiner::calcPseudoInverse()
+{
+    int n = windowSize * windowSize;
+    cv::Mat A(n, 6, CV_64F);
+    cv::Mat AtW(6, n, CV_64F);
+
+    // gaussian weights so the fit is dominated by pixels close to the point
+    double sigma = std::max(1.0, radius / 2.0);
+    int k = 0;
+    for (int dy = -radius; dy <= radius; dy++){
+        for (int dx = -radius; dx <= radius; dx++){
+            double w = std::exp(-(dx*dx + dy*dy) / (2 * sigma * sigma));
+            double row[6] = {(double) dx*dx, (double) dx*dy, (double) dy*dy, (double) dx, (double) dy, 1};
+            for (int c = 0; c < 6; c++){
+                A.at<double>(k, c) = row[c];
+                AtW.at<double>(c, k) = row[c] * w;
+            }
+            k++;
+        }
+    }
+
+    cv::Mat N = AtW * A;
+    cv::Mat Ninv = N.inv(cv::DECOMP_SVD);
+    cv::Mat P = Ninv * AtW;
+
+    // store pixel major so each pixel updates six contiguous coefficients
+    pseudoInverse.resize(n * 6);
+    for (int i = 0; i < n; i++){
+        for (int c = 0; c < 6; c++){
+            pseudoInverse[i * 6 + c] = P.at<double>(c, i);
+        }
+    }
+}
+
+bool CornerRefiner::fitSaddle(const cv::Point& center, cv::Point2d& offset) const
+{
+    if (center.x - radius < 0 || center.y - radius < 0 || center.x + radius >= image.cols || center.y + radius >= image.rows){
+        return false;
+    }
+
+    double coeffs[6] = {0, 0, 0, 0, 0, 0};
+    const double* p = &pseudoInverse[0];
+    for (int dy = -radius; dy <= radius; dy++){
+        const uchar* row = image.ptr<uchar>(center.y + dy) + center.x - radius;
+        for (int dx = 0; dx < windowSize; dx++){
+            double v = row[dx];
+            for (int c = 0; c < 6; c++){
+                coeffs[c] += p[c] * v;
+            }
+            p += 6;
+        }
+    }
+
+    double a = coeffs[0], b = coeffs[1], c = coeffs[2], d = coeffs[3], e = coeffs[4];
+
+    // stationary point of the quadratic, it is a saddle only if the hessian is indefinite
+    double det = 4 * a * c - b * b;
+    if (det >= 0){
+        return false;
+    }
+
+    offset.x = (b * e - 2 * c * d) / det;
+    offset.y = (b * d - 2 * a * e) / det;
+    return true;
+}
+
+bool CornerRefiner::refine(cv::Point2d& point) const
+{
+    cv::Point center(cvRound(point.x), cvRound(point.y));
+
+    for (int i = 0; i < maxIterations; i++){
+        cv::Point2d offset;
+        if (!fitSaddle(center, offset)){
+            return false;
+        }
+
+        if (std::abs(offset.x) > radius || std::abs(offset.y) > radius){
+            return false; // the fit diverged, keep the original point
+        }
+
+        if (std::abs(offset.x) <= 0.5 && std::abs(offset.y) <= 0.5){
+            cv::Point2d refined(center.x + offset.x, center.y + offset.y);
+            if (std::abs(refined.x - point.x) > radius || std::abs(refined.y - point.y) > radius){
+                return false;
+            }
+            point = refined;
+            return true;
+        }
+
+        // saddle is closer to another pixel, refit around that one
+        center.x += cvRound(offset.x);
+        center.y += cvRound(offset.y);
+    }
+    return false;
+}
+
+size_t CornerRefiner::refine(Points2d& points) const
+{
+    if (points.empty()){
+        return 0;
+    }
+
+    std::atomic<size_t> moved(0);
+    cv::parallel_for_(cv::Range(0, (int) points.size()), RefineBody(*this, points, moved));
+    return moved;
+}
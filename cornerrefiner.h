@@ -0,0 +1,38 @@
+#ifndef CORNERREFINER_H
+#define CORNERREFINER_H
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "typedefs.h"
+
+// Refines lattice points to sub-pixel accuracy by fitting a quadratic surface
+// f(x,y) = ax^2 + bxy + cy^2 + dx + ey + f to the gray levels around each point
+// and moving the point to the saddle of the surface, where the gradient vanishes.
+// The least squares solution only depends on the window, so it is computed once
+// and every point in a batch is refined with a few dot products.
+class CornerRefiner
+{
+public:
+    CornerRefiner(const cv::Mat& image, int radius = 5, int maxIterations = 3);
+
+    // Refines on another image of the next frame, the least squares solution is kept
+    void setImage(const cv::Mat& image);
+    int getRadius() const {return radius;}
+    int getMaxIterations() const {return maxIterations;}
+
+    // Refines all points in place, in parallel. Returns the number of points that moved.
+    size_t refine(Points2d& points) const;
+    bool refine(cv::Point2d& point) const;
+
+private:
+    cv::Mat image;
+    int radius;
+    int maxIterations;
+    int windowSize;
+    std::vector<double> pseudoInverse; // 6 x windowSize^2, row major
+
+    void calcPseudoInverse();
+    bool fitSaddle(const cv::Point& center, cv::Point2d& offset) const;
+};
+
+#endif // CORNERREFINER_H
@@ -4,6 +4,7 @@
 #include <fstream>
 #include <math.h>
 #include "cvutils.h"
+#include "log.h"
 
 using namespace cv;
 using namespace std;
@@ -66,9 +67,9 @@ void cvutils::PrintMatToFile(Mat& mat, int lastRow, int lastCol, string fileName
     myfile.open(fileName);
 
     if (!myfile.is_open()){
-        cout << "Cannot open the file" << endl;
+        LOG_WARN("Cannot open the file " << fileName);
     } else {
-        cout << "Printing..." << endl;
+        LOG_INFO("Printing to " << fileName);
 
         for(int i = 0; i < lastRow; i++)
         {
@@ -279,7 +280,7 @@ void cvutils::plotPoints(Mat &image, Points2d &points, int radius, cv::Scalar co
         if (!negCoordinate(pt))
             cv::circle(rgb, pt, radius, col, lineThickness);
         else
-            std::cout << "negative point" << std::endl;
+            LOG_WARN("negative point");
     }
     cv::imshow("points", rgb);
     cv::waitKey();
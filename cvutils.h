@@ -8,6 +8,7 @@
 #include <opencv2/opencv.hpp>
 #include "typedefs.h"
 #include "global.h"
+#include "log.h"
 
 namespace cvutils {
 
@@ -135,10 +136,10 @@ std::vector<size_t> flagOutliers(std::vector<T> vec, double tolerancePct = 0.1){
     }
 
     double mean = meanNoOutliers(vec);
-    std::cout << "mean: " << mean << std::endl;
+    LOG_TRACE("mean: " << mean);
 
     double tolerance = mean * tolerancePct;
-    std::cout << "tolerance: " << tolerance << std::endl;
+    LOG_TRACE("tolerance: " << tolerance);
 
     std::vector<double> dists(vec.size());
 
@@ -155,7 +156,7 @@ std::vector<size_t> flagOutliers(std::vector<T> vec, double tolerancePct = 0.1){
         } else {
             flags.at(i) = 0;
         }
-        std::cout << "flag[" <<i <<"]: " << flags.at(i) << std::endl;
+        LOG_TRACE("flag[" <<i <<"]: " << flags.at(i));
 
     }
     return flags;
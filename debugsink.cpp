@@ -0,0 +1,179 @@
+#include "debugsink.h"
+#include "board.h"
+#include "cvutils.h"
+#include "log.h"
+
+DebugSink& DebugSink::instance()
+{
+    static DebugSink sink;
+    return sink;
+}
+
+DebugSink::DebugSink(size_t capacity_)
+{
+    capacity = capacity_;
+    stopping = false;
+    busy = 0;
+    queuedViews = 0;
+    dropped = 0;
+    droppedLogged = 0;
+    rendered = 0;
+    worker = std::thread(&DebugSink::run, this);
+}
+
+DebugSink::~DebugSink()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    worker.join();
+}
+
+bool DebugSink::write(const Board& board, const cv::Mat& image, const std::string& filename)
+{
+    return push(board, image, filename, false);
+}
+
+bool DebugSink::show(const Board& board, const cv::Mat& image, const std::string& window)
+{
+    return push(board, image, window, true);
+}
+
+bool DebugSink::push(const Board& board, const cv::Mat& image, const std::string& target, bool toWindow)
+{
+    if (board.empty() || !image.data){
+        return false;
+    }
+
+    // only the geometry is copied here, everything else is left to the worker
+    Snapshot snapshot;
+    snapshot.target = target;
+    snapshot.toWindow = toWindow;
+    snapshot.image = image;
+    snapshot.corners.reserve(board.size() * 4);
+    for (size_t i = 0; i < board.size(); i++){
+        const Square& square = board.getElementRef(i);
+        for (size_t corner = 0; corner < 4; corner++){
+            snapshot.corners.push_back(square.getCornerpoint(corner));
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (toWindow){
+            if (queuedViews >= capacity){
+                dropped++;
+                return false;
+            }
+            queuedViews++;
+        }
+        queue.push_back(std::move(snapshot));
+    }
+    wake.notify_one();
+    return true;
+}
+
+void DebugSink::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true){
+        wake.wait(lock, [this]{return stopping || !queue.empty();});
+        if (queue.empty()){
+            return; // stopping and nothing left to render
+        }
+
+        Snapshot snapshot = std::move(queue.front());
+        queue.pop_front();
+        if (snapshot.toWindow){
+            queuedViews--;
+        }
+        busy++;
+        lock.unlock();
+
+        try{
+            cv::Mat img;
+            bool drawn = render(snapshot.image, snapshot.corners, img); // nothing is written otherwise, like Board::write
+            if (drawn && snapshot.toWindow){
+                std::lock_guard<std::mutex> showLock(mutex);
+                toShow.push_back(std::make_pair(snapshot.target, img));
+            } else if (drawn){
+                cv::imwrite(snapshot.target, img);
+            }
+        } catch(std::exception& e){
+            LOG_WARN("Debug image " << snapshot.target << " not rendered: " << e.what());
+        }
+
+        lock.lock();
+        busy--;
+        rendered++;
+        if (queue.empty() && busy == 0){
+            idle.notify_all();
+        }
+    }
+}
+
+void DebugSink::showPending()
+{
+    std::vector<std::pair<std::string, cv::Mat> > images;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        images.swap(toShow);
+    }
+    for (size_t i = 0; i < images.size(); i++){
+        cv::imshow(images[i].first, images[i].second);
+    }
+    if (!images.empty()){
+        cv::waitKey(1);
+    }
+}
+
+void DebugSink::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this]{return queue.empty() && busy == 0;});
+    if (dropped > droppedLogged){
+        LOG_WARN("Debug views dropped: " << dropped - droppedLogged << ", " << dropped << " in total");
+        droppedLogged = dropped;
+    }
+}
+
+size_t DebugSink::getDropped() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return dropped;
+}
+
+size_t DebugSink::getRendered() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return rendered;
+}
+
+bool DebugSink::render(const cv::Mat& image, const Points2d& corners, cv::Mat& dst)
+{
+    for (size_t i = 0; i < corners.size(); i++){
+        if (cvutils::negCoordinate(corners[i])){
+            LOG_WARN("At least one point has a negative index, cannot draw");
+            return false;
+        }
+    }
+
+    cv::Mat img_draw;
+    if (image.channels() == 1){
+        cv::cvtColor(image, img_draw, cv::COLOR_GRAY2BGR);
+    } else {
+        image.copyTo(img_draw);
+    }
+
+    cv::RNG rng = cv::RNG(1234);
+    for (size_t i = 0; i + 3 < corners.size(); i += 4) {
+        cv::Scalar col = cv::Scalar(rng.uniform(0,255), rng.uniform(0,255), rng.uniform(0,255));
+        Points2d cps(corners.begin() + i, corners.begin() + i + 4);
+        Points cornerpoints = cvutils::doubleToInt(cps);
+        cv::fillConvexPoly(img_draw, cornerpoints, col);
+    }
+    dst = img_draw;
+    return true;
+}
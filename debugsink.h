@@ -0,0 +1,74 @@
+#ifndef DEBUGSINK_H
+#define DEBUGSINK_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "typedefs.h"
+
+class Board;
+
+// Renders debug images of the board off the detection thread. On the hot path the detector
+// only copies the corner points of the squares; drawing, PNG encoding and writing happen on
+// a worker thread. Report files are always written. Views for windows are bounded and never
+// block the detector: a view that does not fit is dropped, counted and logged by flush().
+//
+// HighGUI windows must be created on the GUI thread, so images queued with show() are
+// rendered by the worker and put on screen by the next call to showPending().
+class DebugSink
+{
+public:
+    static DebugSink& instance();
+
+    explicit DebugSink(size_t capacity = 16); // views queued at once
+    ~DebugSink(); // renders what is still queued
+
+    // Queue the squares of the board, filled on top of image. image is shared, not copied,
+    // so its pixels must not change until flush() returns: call flush() at the end of every
+    // detection run, before the next one overwrites the global images. show() returns false
+    // when the view was dropped.
+    bool write(const Board& board, const cv::Mat& image, const std::string& filename);
+    bool show(const Board& board, const cv::Mat& image, const std::string& window);
+
+    void showPending(); // call from the GUI thread
+    void flush();       // waits until every queued snapshot is rendered, logs dropped views
+
+    size_t getDropped() const;
+    size_t getRendered() const;
+
+    // Each square filled with its own colour, the same colours for every call. False, and
+    // dst left alone, when a square has a negative coordinate.
+    static bool render(const cv::Mat& image, const Points2d& corners, cv::Mat& dst);
+
+private:
+    struct Snapshot
+    {
+        std::string target; // file or window name
+        bool toWindow;
+        cv::Mat image;
+        Points2d corners;   // four per square, sorted like Square::getCornerpointsSorted()
+    };
+
+    size_t capacity;
+    bool stopping;
+    size_t busy;
+    size_t queuedViews;
+    size_t dropped;
+    size_t droppedLogged; // dropped views already reported by flush()
+    size_t rendered;
+    std::deque<Snapshot> queue;
+    std::vector<std::pair<std::string, cv::Mat> > toShow;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::thread worker;
+
+    bool push(const Board& board, const cv::Mat& image, const std::string& target, bool toWindow);
+    void run();
+};
+
+#endif // DEBUGSINK_H
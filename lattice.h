@@ -0,0 +1,132 @@
+#ifndef LATTICE_H
+#define LATTICE_H
+
+#include <array>
+#include <cstddef>
+#include "typedefs.h"
+
+// Compile time index sequence, std::index_sequence is not available in C++11
+template <size_t... Is> struct indexSequence {};
+template <size_t N, size_t... Is> struct makeIndexSequence : makeIndexSequence<N-1, N-1, Is...> {};
+template <size_t... Is> struct makeIndexSequence<0, Is...> {typedef indexSequence<Is...> type;};
+
+// Table holding F::at(0), ..., F::at(N-1), evaluated by the compiler
+template <class F, class T, class Seq> struct constexprTable;
+
+template <class F, class T, size_t... Is>
+struct constexprTable<F, T, indexSequence<Is...> >
+{
+    static constexpr size_t size = sizeof...(Is);
+    static constexpr T values[sizeof...(Is)] = {F::at(Is)...};
+};
+
+template <class F, class T, size_t... Is>
+constexpr T constexprTable<F, T, indexSequence<Is...> >::values[sizeof...(Is)];
+
+// Index maths for a lattice of Rows x Cols squares and (Rows+1) x (Cols+1) vertices.
+// Squares and vertices are numbered row by row. The corners of a square are numbered
+// upper left, upper right, lower right, lower left like Square::getCornerpointsSorted().
+template <size_t Rows, size_t Cols>
+struct LatticeIndex
+{
+    static_assert(Rows > 1 && Cols > 1 && Cols % 2 == 0, "Lattice needs an even number of columns");
+
+    static constexpr size_t rows = Rows;
+    static constexpr size_t cols = Cols;
+    static constexpr size_t nSquares = Rows * Cols;
+    static constexpr size_t nVertices = (Rows + 1) * (Cols + 1);
+    static constexpr size_t nBlack = Rows * Cols / 2;
+    static constexpr size_t none = static_cast<size_t>(-1);
+
+    static constexpr size_t row(size_t idx){return idx / Cols;}
+    static constexpr size_t col(size_t idx){return idx % Cols;}
+    static constexpr size_t index(size_t r, size_t c){return r * Cols + c;}
+
+    static constexpr size_t squareAt(long r, long c){
+        return (r < 0 || c < 0 || r >= (long) Rows || c >= (long) Cols) ? none : index(r, c);
+    }
+
+    // Black squares are the ones where row + col is odd, the upper left square is white
+    static constexpr bool isBlack(size_t idx){return (row(idx) + col(idx)) % 2 == 1;}
+
+    // Index of the k'th black square
+    static constexpr size_t blackSquare(size_t k){
+        return index(k / (Cols / 2), 2 * (k % (Cols / 2)) + ((k / (Cols / 2)) % 2 == 0 ? 1 : 0));
+    }
+
+    static constexpr size_t vertexAt(long r, long c){
+        return (r < 0 || c < 0 || r > (long) Rows || c > (long) Cols) ? none : r * (Cols + 1) + c;
+    }
+
+    // Neighbouring vertex of vertex v in direction dir, none at the lattice border
+    static constexpr size_t neighbour(size_t v, Direction dir){
+        return dir == UP ? vertexAt((long) (v / (Cols + 1)) - 1, v % (Cols + 1))
+             : dir == RIGHT ? vertexAt(v / (Cols + 1), (long) (v % (Cols + 1)) + 1)
+             : dir == DOWN ? vertexAt((long) (v / (Cols + 1)) + 1, v % (Cols + 1))
+             : vertexAt(v / (Cols + 1), (long) (v % (Cols + 1)) - 1);
+    }
+
+    // Square that has vertex v as its corner 0-3, none at the lattice border.
+    // Interior vertices are shared by four squares.
+    static constexpr size_t squareAtVertex(size_t v, size_t corner){
+        return squareAt((long) (v / (Cols + 1)) - (corner >= 2 ? 1 : 0),
+                        (long) (v % (Cols + 1)) - ((corner == 1 || corner == 2) ? 1 : 0));
+    }
+
+    // Square types as determined by Square::determineType: inner 4, border 3, corner 2
+    static constexpr int expectedType(size_t idx){
+        return 4 - ((row(idx) == 0 || row(idx) == Rows - 1) ? 1 : 0) - ((col(idx) == 0 || col(idx) == Cols - 1) ? 1 : 0);
+    }
+
+    struct blackSquareFn {static constexpr size_t at(size_t k){return blackSquare(k);}};
+    struct neighbourFn {static constexpr size_t at(size_t i){return neighbour(i / 4, static_cast<Direction>(i % 4));}};
+    struct sharingFn {static constexpr size_t at(size_t i){return squareAtVertex(i / 4, i % 4);}};
+    struct expectedTypeFn {static constexpr int at(size_t i){return expectedType(i);}};
+};
+
+template <size_t Rows, size_t Cols> constexpr size_t LatticeIndex<Rows, Cols>::rows;
+template <size_t Rows, size_t Cols> constexpr size_t LatticeIndex<Rows, Cols>::cols;
+template <size_t Rows, size_t Cols> constexpr size_t LatticeIndex<Rows, Cols>::nSquares;
+template <size_t Rows, size_t Cols> constexpr size_t LatticeIndex<Rows, Cols>::nVertices;
+template <size_t Rows, size_t Cols> constexpr size_t LatticeIndex<Rows, Cols>::nBlack;
+template <size_t Rows, size_t Cols> constexpr size_t LatticeIndex<Rows, Cols>::none;
+
+// Lookup tables for the functions above
+template <size_t Rows, size_t Cols>
+struct LatticeTables
+{
+    typedef LatticeIndex<Rows, Cols> Index;
+
+    typedef constexprTable<typename Index::blackSquareFn, size_t, typename makeIndexSequence<Index::nBlack>::type> blackSquares;    // [k]
+    typedef constexprTable<typename Index::neighbourFn, size_t, typename makeIndexSequence<Index::nVertices * 4>::type> neighbours; // [vertex*4 + dir]
+    typedef constexprTable<typename Index::sharingFn, size_t, typename makeIndexSequence<Index::nVertices * 4>::type> sharedBy;   // [vertex*4 + corner]
+    typedef constexprTable<typename Index::expectedTypeFn, int, typename makeIndexSequence<Index::nSquares>::type> expectedTypes; // [idx]
+};
+
+// Fixed size row major storage of values on a lattice, unlike matrix<T> it never
+// allocates and all loop bounds are known at compile time.
+template <class T, size_t Rows, size_t Cols>
+class Lattice
+{
+public:
+    static constexpr size_t rows = Rows;
+    static constexpr size_t cols = Cols;
+    static constexpr size_t size = Rows * Cols;
+
+    T& operator()(size_t row, size_t col){return values[row * Cols + col];}
+    const T& operator()(size_t row, size_t col) const {return values[row * Cols + col];}
+    T& operator[](size_t idx){return values[idx];}
+    const T& operator[](size_t idx) const {return values[idx];}
+
+    T* data(){return values.data();}
+    const T* data() const {return values.data();}
+    typename std::array<T, Rows * Cols>::iterator begin(){return values.begin();}
+    typename std::array<T, Rows * Cols>::iterator end(){return values.end();}
+    typename std::array<T, Rows * Cols>::const_iterator begin() const {return values.begin();}
+    typename std::array<T, Rows * Cols>::const_iterator end() const {return values.end();}
+
+private:
+    std::array<T, Rows * Cols> values;
+};
+
+#endif // LATTICE_H
@@ -1,7 +1,9 @@
-#include "Line.h"
+#include "line.h"
 #include "typedefs.h"
 #include "square.h"
 #include <vector>
+#include <cmath>
+#include <algorithm>
 
 Line::Line(){
 
@@ -100,7 +102,7 @@ void Line::calcIntercept(){
     yIntercept = y1 - slope*x1;
 }
 
-bool Line::Intersection(Line& otherline, cv::Point2d& result) const {
+bool Line::Intersection(const Line& otherline, cv::Point2d& result) const {
     // y = ax + b; y = cx + d; solve for intersection
 
     double a = slope;
@@ -135,6 +137,84 @@ bool Line::Intersection(Line& otherline, cv::Point2d& result) const {
     return true;
 }
 
+int Line::fitToEdges(const cv::Mat& edges, int halfBand, int iterations)
+{ // Returns the number of edge pixels the line was fitted to, 0 if it was left unchanged
+    if (points.size() != 2 || edges.empty() || edges.type() != CV_8UC1){
+        return 0;
+    }
+
+    cv::Point2d p1 = points[0];
+    cv::Point2d p2 = points[1];
+    cv::Point2d dir = p2 - p1;
+    double length = cv::norm(dir);
+    if (length < 1){
+        return 0;
+    }
+    dir = dir * (1.0 / length);
+    cv::Point2d normal(-dir.y, dir.x);
+
+    // Gather edge pixels in a band around the segment, cost is bounded by length * band
+    Points2d edgePoints;
+    edgePoints.reserve((size_t) length * 2);
+    for (int t = 0; t <= (int) length; t++){
+        cv::Point2d base = p1 + dir * (double) t;
+        for (int s = -halfBand; s <= halfBand; s++){
+            cv::Point2d q = base + normal * (double) s;
+            int x = cvRound(q.x);
+            int y = cvRound(q.y);
+            if (x < 0 || y < 0 || x >= edges.cols || y >= edges.rows)
+                continue;
+            if (edges.at<uchar>(y, x) > 0)
+                edgePoints.push_back(cv::Point2d(x, y));
+        }
+    }
+
+    if (edgePoints.size() < length / 4){
+        return 0; // too little support, keep the Hough estimate
+    }
+
+    // Iteratively reweighted orthogonal regression, pixels far from the current estimate count less
+    cv::Point2d center = p1;
+    double sigma = std::max(1.0, halfBand / 2.0);
+    for (int it = 0; it < iterations; it++){
+        double sw = 0, sx = 0, sy = 0;
+        for (size_t i = 0; i < edgePoints.size(); i++){
+            double d = (edgePoints[i] - center).dot(normal) / sigma;
+            double w = 1 / (1 + d*d);
+            sw += w;
+            sx += w * edgePoints[i].x;
+            sy += w * edgePoints[i].y;
+        }
+        cv::Point2d mean(sx / sw, sy / sw);
+
+        double sxx = 0, syy = 0, sxy = 0;
+        for (size_t i = 0; i < edgePoints.size(); i++){
+            double d = (edgePoints[i] - center).dot(normal) / sigma;
+            double w = 1 / (1 + d*d);
+            double dx = edgePoints[i].x - mean.x;
+            double dy = edgePoints[i].y - mean.y;
+            sxx += w * dx * dx;
+            syy += w * dy * dy;
+            sxy += w * dx * dy;
+        }
+
+        double theta = 0.5 * std::atan2(2 * sxy, sxx - syy);
+        dir = cv::Point2d(std::cos(theta), std::sin(theta));
+        normal = cv::Point2d(-dir.y, dir.x);
+        center = mean;
+    }
+
+    // Keep the extent of the original segment
+    cv::Point2d q1 = center + dir * (p1 - center).dot(dir);
+    cv::Point2d q2 = center + dir * (p2 - center).dot(dir);
+    if (cvutils::negCoordinate(q1) || cvutils::negCoordinate(q2)){
+        return 0;
+    }
+
+    *this = Line(q1, q2);
+    return (int) edgePoints.size();
+}
+
 // Static methods
 void Line::Intersections(std::vector<Line>& lines, std::vector<cv::Point2d>& intersections, cv::Point2d limits, std::vector<double>& distances)
 {
@@ -0,0 +1,78 @@
+#include <cstdio>
+#include <cstring>
+#include "log.h"
+
+namespace {
+
+const char* const prefixes[] = {"[trace] ", "[debug] ", "[info] ", "[warn] ", "[error] "};
+
+} // end anonymous namespace
+
+namespace logging {
+
+void Buffer::append(const char* text, size_t length){
+    if (used + length > capacity){
+        flush();
+        if (length > capacity){
+            fwrite(text, 1, length, stdout);
+            return;
+        }
+    }
+    memcpy(data + used, text, length);
+    used += length;
+}
+
+void Buffer::flush(){
+    if (used > 0){
+        fwrite(data, 1, used, stdout);
+        fflush(stdout);
+        used = 0;
+    }
+}
+
+Buffer& threadBuffer(){
+    static thread_local Buffer buffer;
+    return buffer;
+}
+
+void flush(){
+    threadBuffer().flush();
+}
+
+Record::Record(int level_) : level(level_), buffer(threadBuffer()){
+    *this << prefixes[level < LOG_LEVEL_TRACE ? LOG_LEVEL_TRACE : level > LOG_LEVEL_ERROR ? LOG_LEVEL_ERROR : level];
+}
+
+Record::~Record(){
+    buffer.append("\n", 1);
+    if (level >= LOG_LEVEL_WARN)
+        buffer.flush();
+}
+
+Record& Record::operator<<(const char* text){
+    buffer.append(text, strlen(text));
+    return *this;
+}
+
+Record& Record::operator<<(double value){
+    char text[32];
+    int length = snprintf(text, sizeof(text), "%g", value); // like std::cout
+    buffer.append(text, length);
+    return *this;
+}
+
+Record& Record::appendSigned(long long value){
+    char text[24];
+    int length = snprintf(text, sizeof(text), "%lld", value);
+    buffer.append(text, length);
+    return *this;
+}
+
+Record& Record::appendUnsigned(unsigned long long value){
+    char text[24];
+    int length = snprintf(text, sizeof(text), "%llu", value);
+    buffer.append(text, length);
+    return *this;
+}
+
+} // end namespace logging
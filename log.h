@@ -0,0 +1,105 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <cstddef>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
+// Leveled diagnostics, used like
+//
+//     LOG_DEBUG("Removed row: " << row);
+//
+// Levels below LOG_MIN_LEVEL are behind a condition that is false at compile time, the
+// message is type checked but never evaluated and the compiler drops it. The others are
+// formatted into a buffer owned by the calling thread, so logging takes no lock and does
+// no console I/O. A thread's buffer is written to stdout when it is full, when the thread
+// ends, after a warning or an error and on logging::flush(). Threads that are never joined,
+// like the pool behind cv::parallel_for_, call logging::flush() at the end of each body.
+// Lines of one thread stay in order, lines of different threads are only ordered per flush.
+//
+// Set the minimum level for a build with DEFINES += LOG_MIN_LEVEL=0 (trace) to 5 (off).
+
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO  2
+#define LOG_LEVEL_WARN  3
+#define LOG_LEVEL_ERROR 4
+#define LOG_LEVEL_OFF   5
+
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_AT(level, message) \
+    do { if (logging::enabled(level)) { logging::Record(level) << message; } } while (0)
+
+#define LOG_TRACE(message) LOG_AT(LOG_LEVEL_TRACE, message)
+#define LOG_DEBUG(message) LOG_AT(LOG_LEVEL_DEBUG, message)
+#define LOG_INFO(message)  LOG_AT(LOG_LEVEL_INFO, message)
+#define LOG_WARN(message)  LOG_AT(LOG_LEVEL_WARN, message)
+#define LOG_ERROR(message) LOG_AT(LOG_LEVEL_ERROR, message)
+
+namespace logging {
+
+constexpr bool enabled(int level){return level >= LOG_MIN_LEVEL;}
+
+// Lines logged by one thread, written out in one go
+class Buffer
+{
+public:
+    static const size_t capacity = 1 << 16;
+
+    Buffer() : used(0) {}
+    ~Buffer(){flush();}
+
+    void append(const char* text, size_t length);
+    void flush();
+
+private:
+    char data[capacity];
+    size_t used;
+};
+
+Buffer& threadBuffer();
+void flush(); // the calling thread's buffer
+
+// One line, ended when the record goes out of scope. Numbers and strings are formatted
+// in place, anything else with its ostream operator.
+class Record
+{
+public:
+    explicit Record(int level);
+    ~Record();
+
+    Record& operator<<(const char* text);
+    Record& operator<<(const std::string& text){buffer.append(text.data(), text.size()); return *this;}
+    Record& operator<<(char c){buffer.append(&c, 1); return *this;}
+    Record& operator<<(bool value){return *this << (value ? "1" : "0");}
+    Record& operator<<(double value);
+
+    template <class T>
+    typename std::enable_if<std::is_integral<T>::value, Record&>::type operator<<(T value){
+        return std::is_signed<T>::value ? appendSigned((long long) value) : appendUnsigned((unsigned long long) value);
+    }
+
+    template <class T>
+    typename std::enable_if<!std::is_arithmetic<T>::value, Record&>::type operator<<(const T& value){
+        std::ostringstream os;
+        os << value;
+        return *this << os.str();
+    }
+
+private:
+    int level;
+    Buffer& buffer;
+
+    Record(const Record&);
+    Record& operator=(const Record&);
+    Record& appendSigned(long long value);
+    Record& appendUnsigned(unsigned long long value);
+};
+
+} // end namespace logging
+
+#endif // LOG_H
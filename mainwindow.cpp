@@ -4,10 +4,12 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include "opencvbook.cpp"
-#include "Line.h"
+#include "line.h"
 #include "square.h"
 #include "preprocess.h"
 #include "boarddetector.h"
+#include "report.h"
+#include "debugsink.h"
 #include "cvutils.h"
 #include "typedefs.h"
 #include "matrix.h"
@@ -20,6 +22,7 @@
 #include "minimax.h"
 #include "utils.h"
 #include "global.h"
+#include "log.h"
 
 cv::Mat global::image, global::image_gray, global::image_norm, global::image_rgb, global::image_pieces, global::image_hough_mod;
 bool global::doDraw;
@@ -28,6 +31,7 @@ MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow)
 {
+    frameCount = 0;
     ui->setupUi(this);
     //ui->pushButton_2->setEnabled(false);
 }
@@ -54,7 +58,7 @@ void MainWindow::on_pushButton_2_clicked()
     bool saveimages = true;
     global::doDraw = true;
     std::string reportPath = "/Users/benedicte/Dropbox/kings/thesis/report/"+casen+"/";
-    //std::string filename =  "Report_" + utils::currentDateTime();
+    std::string reportFile = reportPath + "report.jsonl"; // one line per detection, timestamped
 
     //if (ui->UseDefaultglobal::image_imp->isChecked()){
     if (!global::image_rgb.data){
@@ -77,6 +81,7 @@ void MainWindow::on_pushButton_2_clicked()
      Settings::PreprocessSettings settings;
      settings.gaussianBlurSigma = 3;
      settings.gaussianBlurSize = cv::Size(3,3);
+     Settings::BoardSettings boardSettings;
 
      // print image channels
      if (saveimages){
@@ -90,12 +95,16 @@ void MainWindow::on_pushButton_2_clicked()
     Board board; // container for the detected board
     bool tryAgain = true;
     bool boardDetected = false;
+    Report report;
+    int retries = 0;
 
 
     while (tryAgain){
+        double duration = static_cast<double>(cv::getTickCount());
         prep.detectLines(settings);
         prep.getLines(houghlines);
-        BoardDetector cbd = BoardDetector(houghlines);
+        duration = (static_cast<double>(cv::getTickCount()) - duration) / cv::getTickFrequency();
+        BoardDetector cbd = BoardDetector(houghlines, boardSettings, prep.getCanny());
         prep.showCanny();
         prep.showHoughlines();
 
@@ -111,13 +120,17 @@ void MainWindow::on_pushButton_2_clicked()
         }
 
         try{
-            std::cout << "Trying to detect board with blur sigma " << settings.gaussianBlurSigma << std::endl;
+            LOG_INFO("Trying to detect board with blur sigma " << settings.gaussianBlurSigma);
 
             boardDetected = cbd.detect(board, &reportPath);
 
 
         } catch(std::exception &e){
         }
+        report = cbd.getReport();
+        report.addTiming("detectLines", duration * 1000);
+        report.frame = frameCount;
+        report.retries = retries++;
 
         if (boardDetected){
             tryAgain = false;
@@ -134,12 +147,17 @@ void MainWindow::on_pushButton_2_clicked()
                 settings.cannyLow -= 4;
             }
             if (settings.gaussianBlurSigma == 1 && settings.gaussianBlurSize == cv::Size(1,1) && settings.cannyLow <= 4){
-                std::cout << "I give up" << std::endl;
+                LOG_WARN("I give up");
             }
         }
     }
 
 
+    if (saveimages)
+        report.appendTo(reportFile); // like the images, skipped with a warning if the directory is missing
+    frameCount++;
+    logging::flush(); // the diagnostics of the detection, before the windows block
+
     // save images
 
 
@@ -159,6 +177,8 @@ void MainWindow::on_pushButton_2_clicked()
     }
 
 
+    DebugSink::instance().flush(); // the queued snapshots share global::image, the next run resizes into it
+    if (global::doDraw) DebugSink::instance().showPending(); // stages of the detection, rendered while it ran
     board.draw();
     cv::destroyAllWindows();
     board.detectPieces();
@@ -173,7 +193,7 @@ void MainWindow::on_pushButton_2_clicked()
 
     State state = board.initState();
 
-    std::cout << "FINISHED" << std::endl;
+    LOG_INFO("FINISHED");
     // WRITE REPORTS
 }
 
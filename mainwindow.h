@@ -4,7 +4,7 @@
 #include <QMainWindow>
 #include <QFileDialog>
 #include <opencv2/opencv.hpp>
-#include "Line.h"
+#include "line.h"
 #include "square.h"
 
 namespace Ui {
@@ -27,6 +27,7 @@ private slots:
 
 private:
     Ui::MainWindow *ui;
+    size_t frameCount; // detections run in this session, numbers the report lines
 };
 
 #endif // MAINWINDOW_H
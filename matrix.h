@@ -2,13 +2,109 @@
 #define MATRIX_H
 
 #include "square.h" // why do i need to include this. If not get incomplete type error
+#include "log.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
 #include <vector>
 #include <iostream>
 #include <string>
 #include <unordered_map>
 
-// Class stores element in a std::vector
+// Random access iterator over every stride'th element from base. Keeps an index rather than
+// a moving pointer, so the end iterator of a column never points outside the storage.
+template <class T>
+class StridedIterator
+{
+public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef typename std::remove_const<T>::type value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef T* pointer;
+    typedef T& reference;
+
+    StridedIterator() : base(nullptr), stride(1), i(0) {}
+    StridedIterator(T* base_, difference_type stride_, difference_type i_) : base(base_), stride(stride_), i(i_) {}
+
+    reference operator*() const {return base[i * stride];}
+    pointer operator->() const {return &base[i * stride];}
+    reference operator[](difference_type n) const {return base[(i + n) * stride];}
+
+    StridedIterator& operator++(){++i; return *this;}
+    StridedIterator& operator--(){--i; return *this;}
+    StridedIterator operator++(int){StridedIterator tmp(*this); ++i; return tmp;}
+    StridedIterator operator--(int){StridedIterator tmp(*this); --i; return tmp;}
+    StridedIterator& operator+=(difference_type n){i += n; return *this;}
+    StridedIterator& operator-=(difference_type n){i -= n; return *this;}
+    StridedIterator operator+(difference_type n) const {return StridedIterator(base, stride, i + n);}
+    StridedIterator operator-(difference_type n) const {return StridedIterator(base, stride, i - n);}
+    friend StridedIterator operator+(difference_type n, const StridedIterator& it){return it + n;}
+    difference_type operator-(const StridedIterator& other) const {return i - other.i;}
+
+    bool operator==(const StridedIterator& other) const {return i == other.i && base == other.base;}
+    bool operator!=(const StridedIterator& other) const {return !(*this == other);}
+    bool operator<(const StridedIterator& other) const {return i < other.i;}
+    bool operator>(const StridedIterator& other) const {return i > other.i;}
+    bool operator<=(const StridedIterator& other) const {return i <= other.i;}
+    bool operator>=(const StridedIterator& other) const {return i >= other.i;}
+
+private:
+    T* base;
+    difference_type stride;
+    difference_type i;
+};
+
+// Non-owning view of a row (stride 1) or a column (stride nCols) of a matrix. Reading or
+// writing through it touches the matrix itself, nothing is copied. A view is invalidated by
+// any change of the matrix size, like an iterator into a std::vector.
+template <class T>
+class StridedView
+{
+public:
+    typedef StridedIterator<T> iterator;
+    typedef typename std::remove_const<T>::type value_type;
+
+    StridedView() : base(nullptr), n(0), step(1) {}
+    StridedView(T* base_, size_t n_, std::ptrdiff_t step_) : base(base_), n(n_), step(step_) {}
+
+    // A mutable view converts to a const one
+    template <class U>
+    StridedView(const StridedView<U>& other, typename std::enable_if<std::is_convertible<U*, T*>::value>::type* = 0)
+        : base(other.data()), n(other.size()), step(other.stride()) {}
+
+    size_t size() const {return n;}
+    bool empty() const {return n == 0;}
+    T* data() const {return base;}
+    std::ptrdiff_t stride() const {return step;}
+
+    T& operator[](size_t i) const {return base[i * step];}
+    T& at(size_t i) const {
+        if (i >= n)
+            throw std::out_of_range("View has " + std::to_string(n) + " elements");
+        return base[i * step];
+    }
+    T& front() const {return base[0];}
+    T& back() const {return base[(n - 1) * step];}
+
+    iterator begin() const {return iterator(base, step, 0);}
+    iterator end() const {return iterator(base, step, (std::ptrdiff_t) n);}
+
+    std::vector<value_type> toVector() const {return std::vector<value_type>(begin(), end());}
+
+private:
+    T* base;
+    size_t n;
+    std::ptrdiff_t step;
+};
+
+// Class stores element in a std::vector. The storage is a grid with free rows and columns
+// on all four sides of the elements (a gap buffer in two dimensions), so rows and columns
+// are added and removed at the edges without moving the existing elements. Indices passed
+// to and returned from the methods below are row major indices of the elements themselves,
+// 0 to size()-1, independent of the headroom.
 template <class T>
 class matrix
 {
@@ -27,26 +123,42 @@ public:
 
     const T& getElementRef(size_t rowIdx, size_t colIdx) const;
     const T& getElementRef(size_t index) const;
-    const std::vector<T>& getElementRefs() const;
+
+    // Unchecked access by row major index
+    T& elementAt(size_t index){return storage[storageIndex(index)];}
+    const T& elementAt(size_t index) const {return storage[storageIndex(index)];}
 
     void setElement(size_t row, size_t col, T element);
 
     size_t getNumCols() const {return nCols;}
     size_t getNumRows() const {return nRows;}
+    size_t size() const {return nRows * nCols;}
+    bool empty() const {return nRows * nCols == 0;}
+
+    // Makes room for at least this many rows and columns on each side, moving the elements at most once
+    void reserveHeadroom(size_t rowsAbove, size_t rowsBelow, size_t colsLeft, size_t colsRight);
+    // Resizes to rows x cols default elements, reusing the storage when it is large enough
+    void reset(size_t rows, size_t cols){initStorage(rows, cols);}
+
+    // Views into the storage, prefer these over the copying getRow and getCol
+    StridedView<T> rowView(size_t rowIdx);
+    StridedView<const T> rowView(size_t rowIdx) const;
+    StridedView<T> colView(size_t colIdx);
+    StridedView<const T> colView(size_t colIdx) const;
 
     std::vector<T> getRow(size_t rowIdx) const;
 
     std::vector<T> getCol(size_t colIdx) const;
 
-    void appendRow(std::vector<T> row);
-    void prependRow(std::vector<T> row);
+    void appendRow(const std::vector<T>& row);
+    void prependRow(const std::vector<T>& row);
 
-    void appendCol(std::vector<T> col);
-    void prependCol(std::vector<T> col);
+    void appendCol(const std::vector<T>& col);
+    void prependCol(const std::vector<T>& col);
 
     void addToElement(size_t row, size_t col, T increment);
-    void addToCol(size_t col, std::vector<T> increments);
-    void addToRow(size_t row, std::vector<T> increments);
+    void addToCol(size_t col, const std::vector<T>& increments);
+    void addToRow(size_t row, const std::vector<T>& increments);
 
     bool removeColRequest(size_t idx);
     std::vector<size_t> removeColsRequest(std::vector<size_t> cols);
@@ -56,43 +168,82 @@ public:
     void removeRowsAgressive(std::vector<size_t> rows);
 
 protected:
-    std::vector<T> elements;
+    std::vector<T> storage; // storageRows x storageCols, the elements start at (top, left)
+    std::vector<T> spare;   // the previous storage, reused when the headroom grows again
 
     size_t nRows;
     size_t nCols;
 
+    size_t top;
+    size_t left;
+    size_t storageRows;
+    size_t storageCols;
+
     size_t getIndex(size_t row, size_t col) const;
     std::pair<size_t,size_t> getRowCol(size_t index) const;
 
     bool getSmartIndex(size_t row, size_t col, size_t &idx) const;
+
+private:
+    size_t storageIndex(size_t row, size_t col) const {return (top + row) * storageCols + left + col;}
+    size_t storageIndex(size_t index) const {return storageIndex(index / nCols, index % nCols);}
+    void clearSlot(size_t row, size_t col){storage[storageIndex(row, col)] = T();}
+    void initStorage(size_t rows, size_t cols);
 };
 
 template <typename T>
 matrix<T>::matrix()
 {
-    nCols = 0;
-    nRows = 0;
+    initStorage(0, 0);
 }
 
 template <typename T>
 matrix<T>::matrix(size_t nRows, size_t nCols, T initval)
 {
-    this->nCols = nCols;
-    this->nRows = nRows;
-
-    std::vector<T> tmp(nRows * nCols, initval);
-    elements = tmp;
+    initStorage(nRows, nCols);
+    std::fill(storage.begin(), storage.end(), initval);
 }
 
 template <typename T>
 matrix<T>::matrix(size_t nRows, size_t nCols)
 {
-    this->nCols = nCols;
-    this->nRows = nRows;
+    initStorage(nRows, nCols);
+}
 
-    std::vector<T> tmp(nRows * nCols);
-    elements = tmp;
+template <typename T>
+void matrix<T>::initStorage(size_t rows, size_t cols)
+{
+    nRows = storageRows = rows;
+    nCols = storageCols = cols;
+    top = left = 0;
+    storage.assign(rows * cols, T());
+}
+
+template <typename T>
+void matrix<T>::reserveHeadroom(size_t rowsAbove, size_t rowsBelow, size_t colsLeft, size_t colsRight)
+{
+    size_t rowsBelowNow = storageRows - top - nRows;
+    size_t colsRightNow = storageCols - left - nCols;
+    if (top >= rowsAbove && rowsBelowNow >= rowsBelow && left >= colsLeft && colsRightNow >= colsRight){
+        return;
+    }
+
+    size_t newTop = std::max(top, rowsAbove);
+    size_t newLeft = std::max(left, colsLeft);
+    size_t newRows = newTop + nRows + std::max(rowsBelowNow, rowsBelow);
+    size_t newCols = newLeft + nCols + std::max(colsRightNow, colsRight);
 
+    spare.assign(newRows * newCols, T());
+    for (size_t row = 0; row < nRows; row++){
+        std::move(storage.begin() + storageIndex(row, 0), storage.begin() + storageIndex(row, 0) + nCols,
+                  spare.begin() + (newTop + row) * newCols + newLeft);
+    }
+
+    storage.swap(spare);
+    top = newTop;
+    left = newLeft;
+    storageRows = newRows;
+    storageCols = newCols;
 }
 
 template <typename T>
@@ -101,13 +252,9 @@ matrix<T> matrix<T>::operator+(const matrix<T> m){
         throw std::invalid_argument("Matrices must be of same size");
     }
 
-    matrix<T> m2;
-    m2.elements.reserve(nCols * nRows);
-    m2.nCols = this->nCols;
-    m2.nRows = this->nRows;
-
-    for (size_t i = 0; i < this->elements.size(); i++){
-        m2.elements.push_back(this->elements.at(i) + m.elements.at(i));
+    matrix<T> m2(nRows, nCols);
+    for (size_t i = 0; i < size(); i++){
+        m2.elementAt(i) = this->elementAt(i) + m.elementAt(i);
     }
     return m2;
 }
@@ -122,240 +269,214 @@ void matrix<T>::copyTo(matrix<T> other) const{
 template <typename T>
 T matrix<T>::getElement(size_t row, size_t col) const
 {
-    size_t idx = getIndex(row, col);
-
-    T element = elements.at(idx);
-    return element;
+    return getElementRef(row, col);
 }
 
 template <typename T>
 T matrix<T>::getElement(size_t index) const
 {
-    if (index >= elements.size())
-        throw std::out_of_range("Matrix has " + std::to_string(elements.size()) + " elements");
-    return elements.at(index);
+    if (index >= size())
+        throw std::out_of_range("Matrix has " + std::to_string(size()) + " elements");
+    return elementAt(index);
 }
 
 template <typename T>
 const T &matrix<T>::getElementRef(size_t rowIdx, size_t colIdx) const
 {
-    size_t idx = getIndex(rowIdx, colIdx);
-
-    if (idx > elements.size()-1){
+    if (rowIdx >= nRows || colIdx >= nCols){
         throw std::out_of_range("Out of range!");
     }
-    const T& ref = elements.at(idx);
-    return ref;
+    return storage[storageIndex(rowIdx, colIdx)];
 }
 
 template <typename T>
 const T &matrix<T>::getElementRef(size_t index) const{
-    if (index >= elements.size())
+    if (index >= size())
         throw std::out_of_range("Out of range");
-    const T& ref = elements.at(index);
-    return ref;
-}
-
-template <typename T>
-const std::vector<T> &matrix<T>::getElementRefs() const
-{
-    const std::vector<T>& refs = elements;
-    return refs;
+    return elementAt(index);
 }
 
 template <typename T>
 void matrix<T>::setElement(size_t row, size_t col, T element){
-    if (row > nRows || col > nCols){
+    if (row >= nRows || col >= nCols){
         throw std::out_of_range("Out of range!");
     }
 
-    size_t idx = getIndex(row, col);
-    elements.at(idx) = element;
+    storage[storageIndex(row, col)] = element;
 }
 
 template <typename T>
 void matrix<T>::addToElement(size_t row, size_t col, T increment){
-    if (row > nRows || col > nCols){
+    if (row >= nRows || col >= nCols){
         throw std::out_of_range("Out of range!");
     }
 
-    size_t idx = getIndex(row, col);
-    elements.at(idx) += increment;
+    storage[storageIndex(row, col)] += increment;
 }
 
 template <typename T>
-void matrix<T>::addToRow(size_t row, std::vector<T> increments){
+void matrix<T>::addToRow(size_t row, const std::vector<T>& increments){
     if (increments.size() != nCols){
         throw std::out_of_range("Row must be of length " + std::to_string(nCols));
     }
 
+    StridedView<T> view = rowView(row);
     for (size_t col = 0; col < increments.size(); col++){
-        size_t idx = getIndex(row, col);
-        elements.at(idx) += increments.at(col);
+        view[col] += increments[col];
     }
 }
 
 template <typename T>
-void matrix<T>::addToCol(size_t col, std::vector<T> increments){
+void matrix<T>::addToCol(size_t col, const std::vector<T>& increments){
     if (increments.size() != nRows){
         throw std::out_of_range("Col must be of length " + std::to_string(nRows));
     }
 
+    StridedView<T> view = colView(col);
     for (size_t row = 0; row < increments.size(); row++){
-        size_t idx = getIndex(row, col);
-        elements.at(idx) += increments.at(row);
+        view[row] += increments[row];
     }
 }
 
 template <typename T>
-std::vector<T> matrix<T>::getRow(size_t rowIdx) const
+StridedView<T> matrix<T>::rowView(size_t rowIdx)
 {
-
     if (rowIdx >= nRows){
         throw std::invalid_argument("row index > number of rows in matrix");
     }
-    if (elements.size() == 0){
-        throw std::invalid_argument("empty matrix");
-    }
-
-    size_t idx1 = rowIdx * nCols;
-    size_t idx2 = idx1 + nCols;
+    return StridedView<T>(&storage[storageIndex(rowIdx, 0)], nCols, 1);
+}
 
-    if (idx2 > elements.size()){
-        throw std::out_of_range("Trying to access element" + std::to_string(idx2) + " but elements is only " + std::to_string(elements.size()) + " long.");
+template <typename T>
+StridedView<const T> matrix<T>::rowView(size_t rowIdx) const
+{
+    if (rowIdx >= nRows){
+        throw std::invalid_argument("row index > number of rows in matrix");
     }
-
-    std::vector<T> row(&elements[idx1], &elements[idx2]);
-    return row;
+    return StridedView<const T>(&storage[storageIndex(rowIdx, 0)], nCols, 1);
 }
 
 template <typename T>
-std::vector<T> matrix<T>::getCol(size_t colIdx) const
+StridedView<T> matrix<T>::colView(size_t colIdx)
 {
     if (colIdx >= nCols){
         throw std::invalid_argument("col index > number of columns in matrix");
     }
+    return StridedView<T>(&storage[storageIndex(0, colIdx)], nRows, (std::ptrdiff_t) storageCols);
+}
 
-    std::vector<T> column(nRows);
-    for (size_t i = 0; i < nRows; i++){
-
-        size_t elementIdx = colIdx + nCols * i;
-        T element = elements.at(elementIdx);
-        column.at(i) = element;
+template <typename T>
+StridedView<const T> matrix<T>::colView(size_t colIdx) const
+{
+    if (colIdx >= nCols){
+        throw std::invalid_argument("col index > number of columns in matrix");
     }
+    return StridedView<const T>(&storage[storageIndex(0, colIdx)], nRows, (std::ptrdiff_t) storageCols);
+}
 
-    return column;
+template <typename T>
+std::vector<T> matrix<T>::getRow(size_t rowIdx) const
+{
+    return rowView(rowIdx).toVector();
 }
 
 template <typename T>
-void matrix<T>::appendRow(std::vector<T> row)
+std::vector<T> matrix<T>::getCol(size_t colIdx) const
+{
+    return colView(colIdx).toVector();
+}
+
+// Growing a side without headroom reserves room for as many rows (or columns) as the matrix
+// already has, so a sequence of edge insertions moves every element only a few times.
+
+template <typename T>
+void matrix<T>::appendRow(const std::vector<T>& row)
 {
     if (row.empty())
         return;
 
-    if (row.size() != nCols){
-        std::invalid_argument("This row has the wrong length for this matrix");
+    if (empty()){ // then this is the first row added, and it will determine number of columns
+        initStorage(1, row.size());
+        std::copy(row.begin(), row.end(), storage.begin());
+        return;
     }
 
-    if (elements.empty()){ // then this is the first row added, and it will determine number of columns
-        nCols = row.size();
+    if (row.size() != nCols){
+        throw std::invalid_argument("This row has the wrong length for this matrix");
     }
 
-    for (size_t i = 0; i < row.size(); i++){
-        elements.push_back(row.at(i));
-    }
+    if (top + nRows == storageRows)
+        reserveHeadroom(0, nRows, 0, 0);
 
     nRows++;
-
+    std::copy(row.begin(), row.end(), rowView(nRows-1).begin());
 }
 
 template <typename T>
-void matrix<T>::prependRow(std::vector<T> row){
+void matrix<T>::prependRow(const std::vector<T>& row){
     if (row.empty())
         return;
-    if (row.size() != nCols){
-        std::invalid_argument("This row has the wrong length for this matrix");
+
+    if (empty()){
+        appendRow(row);
+        return;
     }
-    
-    if (elements.empty()){
-        elements = row;
-        nCols = row.size();
 
-    } else {
-        elements.insert(elements.begin(), row.begin(), row.end());
+    if (row.size() != nCols){
+        throw std::invalid_argument("This row has the wrong length for this matrix");
     }
 
-    nRows++;
+    if (top == 0)
+        reserveHeadroom(nRows, 0, 0, 0);
 
+    top--;
+    nRows++;
+    std::copy(row.begin(), row.end(), rowView(0).begin());
 }
 
 template <typename T>
-void matrix<T>::appendCol(std::vector<T> col)
+void matrix<T>::appendCol(const std::vector<T>& col)
 {
     if (col.empty())
         return;
 
-
-    if (col.size() != nRows){
-        std::invalid_argument("This column has the wrong length for this matrix");
-    }
-
-    if (elements.empty()){
-        elements = col;
-        nCols = 1;
-        nRows = col.size();
+    if (empty()){
+        initStorage(col.size(), 1);
+        std::copy(col.begin(), col.end(), storage.begin());
         return;
     }
 
-    std::vector<T> elementsOld = elements; //std::vector = gives a copy
-    elements.clear();
-
-    size_t j = 0;
-    for (size_t i = 0; i < elementsOld.size(); i++){
-
-        elements.push_back(elementsOld.at(i));
-
-        bool doInsert = (i+1) % nCols == 0;
-        if (doInsert){
-            elements.push_back(col.at(j));
-            j++;
-        }
+    if (col.size() != nRows){
+        throw std::invalid_argument("This column has the wrong length for this matrix");
     }
 
+    if (left + nCols == storageCols)
+        reserveHeadroom(0, 0, 0, nCols);
+
     nCols++;
+    std::copy(col.begin(), col.end(), colView(nCols-1).begin());
 }
 
 template <typename T>
-void matrix<T>::prependCol(std::vector<T> col){
+void matrix<T>::prependCol(const std::vector<T>& col){
     if (col.empty())
         return;
 
-
-    if (col.size() != nRows){
-        std::invalid_argument("This column has the wrong length for this matrix");
-    }
-
-    if (elements.empty()){
-        elements = col;
-        nCols = 1;
-        nRows = col.size();
+    if (empty()){
+        appendCol(col);
         return;
     }
 
-    std::vector<T> elementsOld = elements; //std::vector = gives a copy
-    elements.clear();
-
-    size_t j = 0;
-    for (size_t i = 0; i < elementsOld.size(); i++){
-        bool doInsert = i % nCols == 0;
-        if (doInsert){
-            elements.push_back(col.at(j));
-            j++;
-        }
-        elements.push_back(elementsOld.at(i));
+    if (col.size() != nRows){
+        throw std::invalid_argument("This column has the wrong length for this matrix");
     }
 
+    if (left == 0)
+        reserveHeadroom(0, 0, nCols, 0);
+
+    left--;
     nCols++;
+    std::copy(col.begin(), col.end(), colView(0).begin());
 }
 
 template <typename T>
@@ -368,25 +489,25 @@ bool matrix<T>::removeRowRequest(size_t row){
         throw std::invalid_argument("This matrix is empty");
     }
     if (row != 0 && row != nRows-1){
-        std::cout << "Request to remove row " << row << " denied, can only remove first and last row" << std::endl;
+        LOG_DEBUG("Request to remove row " << row << " denied, can only remove first and last row");
         return false;
     }
 
     if (row > nRows-1){
-        std::cout << "Request to remove row " << row << " denied, this matrix has only " << nRows << " rows." << std::endl;
+        LOG_DEBUG("Request to remove row " << row << " denied, this matrix has only " << nRows << " rows.");
         return false;
     }
 
-    if (row == 0){
-        elements.erase(elements.begin(), elements.begin() + nCols);
+    // the row becomes headroom, the remaining elements stay where they are
+    for (size_t col = 0; col < nCols; col++){
+        clearSlot(row, col);
     }
-
-    else if (row == nRows - 1){
-        elements.erase(elements.end() - nCols, elements.end());
+    if (row == 0){
+        top++;
     }
 
     nRows--;
-    std::cout << "Removed row: " << row << std::endl;
+    LOG_DEBUG("Removed row: " << row);
     return true;
 }
 
@@ -420,9 +541,9 @@ std::vector<size_t> matrix<T>::removeRowsRequest(std::vector<size_t> rows){
         if (check)
             isRemoved.push_back(idxRequested);
 
-        std::cout << rowsIdx << std::endl;
+        LOG_TRACE("rowsIdx: " << rowsIdx);
         idxRequested = rows[--rowsIdx] - decrement;
-        std::cout << rowsIdx << std::endl;
+        LOG_TRACE("rowsIdx: " << rowsIdx);
         idxAllowed--;
 
     }
@@ -449,28 +570,25 @@ bool matrix<T>::removeColRequest(size_t col){
     }
 
     if (col != 0 && col != nCols-1){
-        std::cout << "Request to remove col " << col << " denied, can only remove first and last col" << std::endl;
+        LOG_DEBUG("Request to remove col " << col << " denied, can only remove first and last col");
         return false;
     }
 
     if (col > nCols-1){
-        std::cout << "Request to remove col " << col << " denied, this matrix has only " << nCols << " columns."  <<std::endl;
+        LOG_DEBUG("Request to remove col " << col << " denied, this matrix has only " << nCols << " columns.");
         return false;
     }
 
-    std::vector<T> newElements(elements.size() - nRows);
-
-    size_t count = 0;
-    for (size_t i = 0; i < elements.size(); i++){
-        size_t thiscol = i % nCols;
-        if (thiscol != col){
-            newElements[count++] = elements[i];
-        }
+    // the column becomes headroom, the remaining elements stay where they are
+    for (size_t row = 0; row < nRows; row++){
+        clearSlot(row, col);
+    }
+    if (col == 0){
+        left++;
     }
-    elements.clear();
-    elements = newElements;
+
     nCols--;
-    std::cout << "Removed column: " << col << std::endl;
+    LOG_DEBUG("Removed column: " << col);
     return true;
 }
 
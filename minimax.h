@@ -2,6 +2,7 @@
 #include <limits>
 #include <cstdlib>
 #include "state.h"
+#include "log.h"
 
 namespace checkers
 {
@@ -70,7 +71,7 @@ State play(const State &state, int player)
     state.copyTo(bestMove);
 
     std::vector<State> possibleMoves = state.findMovesForPlayer(player);
-    std::cout << "Found: " << possibleMoves.size() << " initial moves." << std::endl;
+    LOG_DEBUG("Found: " << possibleMoves.size() << " initial moves.");
 
     bool foundWinner = std::any_of(possibleMoves.begin(), possibleMoves.end(), [](State s){return s.isEndOfGame();});
     if (foundWinner){
@@ -1,5 +1,318 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
 #include "piecedetector.h"
+#include "square.h"
+#include "log.h"
 
-PieceDetector::PieceDetector()
+PieceDetector::PieceDetector(const Board& board_, Settings::PieceSettings settings_)
+    : board(board_), settings(settings_)
 {
+    size_t nRows = board.getNumRows();
+    size_t nCols = board.getNumCols();
+    if (nRows == 0 || nCols == 0){
+        throw std::invalid_argument("Board is empty, can't detect pieces");
+    }
+
+    if (settings.rectify){
+        try{
+            rectifier = std::make_shared<BoardRectifier>(board, settings.tileSize);
+            squareSize = settings.tileSize;
+            return;
+        } catch (std::exception& e){
+            LOG_WARN(e.what() << ", detecting pieces in the image instead");
+        }
+    }
+
+    // outer corners of the board
+    Points2d outline{board.getElementRef(0, 0).getCornerpoint(0), board.getElementRef(0, nCols-1).getCornerpoint(1),
+                     board.getElementRef(nRows-1, nCols-1).getCornerpoint(2), board.getElementRef(nRows-1, 0).getCornerpoint(3)};
+    region = cv::boundingRect(cvutils::doubleToInt(outline)) & cv::Rect(0, 0, global::image.cols, global::image.rows);
+
+    double sum = 0;
+    for (size_t i = 0; i < board.size(); i++){
+        const Square& square = board.getElementRef(i);
+        sum += (square.getHLength() + square.getVLength()) / 2.0;
+    }
+    squareSize = sum / board.size();
+}
+
+namespace {
+
+inline double rectSum(const cv::Mat& integral, const cv::Rect& r)
+{
+    return integral.at<double>(r.y + r.height, r.x + r.width) - integral.at<double>(r.y, r.x + r.width)
+         - integral.at<double>(r.y + r.height, r.x) + integral.at<double>(r.y, r.x);
+}
+
+double median(std::vector<double> values)
+{
+    if (values.empty())
+        return 0;
+    std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    return values[values.size() / 2];
+}
+
+} // end anonymous namespace
+
+bool PieceDetector::canHoldPiece(size_t id) const
+{
+    bool is8x8 = board.getNumRows() == BoardIndex::rows && board.getNumCols() == BoardIndex::cols;
+    return !is8x8 || BoardIndex::isBlack(id); // pieces only stand on the black squares
+}
+
+bool PieceDetector::assign(size_t id, std::vector<bool>& taken) const
+{
+    if (id >= taken.size() || taken[id] || !canHoldPiece(id))
+        return false;
+    if (!occupancy.empty() && occupancy[id] == EMPTY)
+        return false;
+    taken[id] = true;
+    return true;
+}
+
+void PieceDetector::classifyOccupancy(const cv::Mat& gray)
+{
+    size_t nSquares = board.size();
+    size_t nCols = board.getNumCols();
+
+    // the statistics are taken inside each tile or bounding box, inset so the board lines are left out
+    cv::Mat src;
+    std::vector<cv::Rect> rects(nSquares);
+    if (isRectified()){
+        rectifier->rectify(gray, src);
+        for (size_t i = 0; i < nSquares; i++){
+            rects[i] = rectifier->getTileRect(i);
+        }
+    } else {
+        src = gray(region);
+        for (size_t i = 0; i < nSquares; i++){
+            cv::Rect bounds = board.getElementRef(i).getBounds();
+            rects[i] = cv::Rect(bounds.x - region.x, bounds.y - region.y, bounds.width, bounds.height);
+        }
+    }
+    cv::Rect all(0, 0, src.cols, src.rows);
+    for (size_t i = 0; i < nSquares; i++){
+        int inset = std::min(rects[i].width, rects[i].height) / 8;
+        rects[i] = cv::Rect(rects[i].x + inset, rects[i].y + inset, rects[i].width - 2 * inset, rects[i].height - 2 * inset) & all;
+    }
+
+    cv::Mat sum, sqsum, edges, edgeSum;
+    cv::integral(src, sum, sqsum, CV_64F);
+    cv::Canny(src, edges, settings.cannyHigh / 2, settings.cannyHigh);
+    cv::integral(edges, edgeSum, CV_64F); // edge pixels are 255
+
+    std::vector<double> means(nSquares, 0), stddevs(nSquares, 0), edgeDensities(nSquares, 0);
+    std::vector<double> parityMeans[2];
+    for (size_t i = 0; i < nSquares; i++){
+        double n = rects[i].area();
+        if (n <= 0)
+            continue;
+        means[i] = rectSum(sum, rects[i]) / n;
+        stddevs[i] = std::sqrt(std::max(0.0, rectSum(sqsum, rects[i]) / n - means[i] * means[i]));
+        edgeDensities[i] = rectSum(edgeSum, rects[i]) / (255 * n);
+        parityMeans[(i / nCols + i % nCols) % 2].push_back(means[i]);
+    }
+
+    // most squares are empty, so the median of each square colour is what an empty square looks like
+    double expected[2] = {median(parityMeans[0]), median(parityMeans[1])};
+
+    occupancy.assign(nSquares, UNCERTAIN);
+    for (size_t i = 0; i < nSquares; i++){
+        if (rects[i].area() <= 0)
+            continue;
+        double deviation = std::abs(means[i] - expected[(i / nCols + i % nCols) % 2]);
+        if (stddevs[i] <= settings.emptyMaxStdDev && edgeDensities[i] <= settings.emptyMaxEdgeDensity && deviation <= settings.emptyMaxColorDeviation)
+            occupancy[i] = EMPTY;
+        else if (stddevs[i] >= settings.occupiedMinStdDev || edgeDensities[i] >= settings.occupiedMinEdgeDensity || deviation >= settings.occupiedMinColorDeviation)
+            occupancy[i] = OCCUPIED;
+    }
+}
+
+double PieceDetector::getSkippedFraction() const
+{
+    size_t candidates = 0;
+    size_t skipped = 0;
+    for (size_t i = 0; i < occupancy.size(); i++){
+        if (!canHoldPiece(i))
+            continue;
+        candidates++;
+        if (occupancy[i] == EMPTY)
+            skipped++;
+    }
+    return candidates > 0 ? skipped / (double) candidates : 0;
+}
+
+std::vector<std::pair<size_t, cv::Vec3i>> PieceDetector::detectCircles(const std::vector<cv::Mat>& channels) const
+{
+    std::vector<std::pair<size_t, cv::Vec3i>> circles;
+    std::vector<bool> taken(board.size(), false);
+
+    int minDist = std::max(1, cvRound(squareSize * settings.minPieceDistance));
+    int minRadius = cvRound(squareSize * settings.minPieceRadius);
+    int maxRadius = cvRound(squareSize * settings.maxPieceRadius);
+
+    cv::Mat rectified, blurred;
+    std::vector<cv::Vec3f> found;
+    Points2d centers;
+    for (size_t c = 0; c < channels.size(); c++){
+        if (isRectified()){
+            rectifier->rectify(channels[c], rectified);
+            cv::GaussianBlur(rectified, blurred, cv::Size(0,0), settings.blurSigma);
+
+            // flatten the empty tiles, HoughCircles only votes from edge pixels so they cost nothing
+            for (size_t i = 0; i < occupancy.size(); i++){
+                if (occupancy[i] == EMPTY){
+                    cv::Mat tile = rectifier->getTile(blurred, i);
+                    tile.setTo(cv::mean(tile));
+                }
+            }
+        } else {
+            cv::GaussianBlur(channels[c](region), blurred, cv::Size(0,0), settings.blurSigma);
+        }
+        found.clear();
+        cv::HoughCircles(blurred, found, CV_HOUGH_GRADIENT, 1, minDist, settings.cannyHigh, settings.accumulatorThreshold, minRadius, maxRadius);
+
+        if (isRectified()){
+            for (size_t i = 0; i < found.size(); i++){
+                cv::Point2d center(found[i][0], found[i][1]);
+                size_t id = rectifier->tileAt(center);
+                if (!assign(id, taken))
+                    continue;
+                cv::Rect tile = rectifier->getTileRect(id);
+                circles.push_back(std::make_pair(id, cv::Vec3i(cvRound(center.x) - tile.x, cvRound(center.y) - tile.y, cvRound(found[i][2]))));
+            }
+            continue;
+        }
+
+        centers.resize(found.size());
+        for (size_t i = 0; i < found.size(); i++){
+            centers[i] = cv::Point2d(found[i][0] + region.x, found[i][1] + region.y);
+        }
+        std::vector<int> ids = board.squareIds(centers);
+        for (size_t i = 0; i < found.size(); i++){
+            size_t id = ids[i];
+            if (!assign(id, taken))
+                continue;
+            cv::Rect bounds = board.getElementRef(id).getBounds();
+            circles.push_back(std::make_pair(id, cv::Vec3i(cvRound(centers[i].x) - bounds.x, cvRound(centers[i].y) - bounds.y, cvRound(found[i][2]))));
+        }
+    }
+    return circles;
+}
+
+std::vector<PieceDetector::PieceColor> PieceDetector::classifyColors(const cv::Mat& gray, const std::vector<std::pair<size_t, cv::Vec3i>>& circles) const
+{
+    std::vector<PieceColor> colors(circles.size());
+    if (circles.empty())
+        return colors;
+
+    // Label image with piece i + 1 painted over the inner part of its circle, in the
+    // rectified image or the board region, so all histograms are filled in one pass
+    cv::Mat src;
+    if (isRectified())
+        rectifier->rectify(gray, src);
+    else
+        src = gray(region);
+
+    cv::Mat labels = cv::Mat::zeros(src.rows, src.cols, CV_8UC1);
+    for (size_t i = 0; i < circles.size(); i++){
+        const cv::Vec3i& circle = circles[i].second;
+        cv::Point origin;
+        if (isRectified()){
+            cv::Rect tile = rectifier->getTileRect(circles[i].first);
+            origin = cv::Point(tile.x, tile.y);
+        } else {
+            cv::Rect bounds = board.getElementRef(circles[i].first).getBounds();
+            origin = cv::Point(bounds.x - region.x, bounds.y - region.y);
+        }
+        int radius = std::max(1, cvRound(circle[2] * settings.pieceMaskRadius));
+        cv::circle(labels, cv::Point(origin.x + circle[0], origin.y + circle[1]), radius, cv::Scalar((double) (i + 1)), -1);
+    }
+
+    int nBins = settings.colorBins;
+    int shift = 0;
+    while ((256 >> shift) > nBins)
+        shift++;
+    nBins = 256 >> shift;
+
+    cv::Mat histograms = cv::Mat::zeros((int) circles.size(), nBins, CV_32F);
+    std::vector<int> counts(circles.size(), 0);
+    for (int y = 0; y < src.rows; y++){
+        const uchar* value = src.ptr<uchar>(y);
+        const uchar* label = labels.ptr<uchar>(y);
+        for (int x = 0; x < src.cols; x++){
+            if (label[x]){
+                histograms.at<float>(label[x] - 1, value[x] >> shift) += 1;
+                counts[label[x] - 1]++;
+            }
+        }
+    }
+
+    // normalised histograms and the mean gray level of each piece
+    std::vector<double> means(circles.size(), 0);
+    for (size_t i = 0; i < circles.size(); i++){
+        float* hist = histograms.ptr<float>((int) i);
+        for (int b = 0; b < nBins; b++){
+            if (counts[i] > 0)
+                hist[b] /= counts[i];
+            means[i] += hist[b] * ((b << shift) + (1 << shift) / 2.0);
+        }
+    }
+
+    // 2-means on the histograms, started from a split at the overall mean so the result is deterministic
+    double overallMean = 0;
+    for (size_t i = 0; i < means.size(); i++){
+        overallMean += means[i] / means.size();
+    }
+    cv::Mat clusters((int) circles.size(), 1, CV_32S);
+    for (size_t i = 0; i < circles.size(); i++){
+        clusters.at<int>((int) i) = means[i] > overallMean ? 1 : 0;
+    }
+
+    double clusterMean[2] = {0, 0};
+    int clusterSize[2] = {0, 0};
+    cv::Mat centers;
+    bool twoColors = circles.size() >= 2;
+    if (twoColors){
+        cv::kmeans(histograms, 2, clusters, cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 20, 1e-4), 1, cv::KMEANS_USE_INITIAL_LABELS, centers);
+        for (size_t i = 0; i < circles.size(); i++){
+            int c = clusters.at<int>((int) i);
+            clusterMean[c] += means[i];
+            clusterSize[c]++;
+        }
+        twoColors = clusterSize[0] > 0 && clusterSize[1] > 0;
+        if (twoColors){
+            clusterMean[0] /= clusterSize[0];
+            clusterMean[1] /= clusterSize[1];
+            twoColors = std::abs(clusterMean[0] - clusterMean[1]) >= settings.minColorSeparation;
+        }
+    }
+
+    if (!twoColors){
+        // only one colour on the board, decide on the absolute gray level
+        for (size_t i = 0; i < circles.size(); i++){
+            colors[i].color = means[i] > 127.5 ? 1 : -1;
+            colors[i].confidence = std::min(1.0, std::abs(means[i] - 127.5) / 127.5);
+        }
+        return colors;
+    }
+
+    int lightCluster = clusterMean[1] > clusterMean[0] ? 1 : 0;
+    for (size_t i = 0; i < circles.size(); i++){
+        const float* hist = histograms.ptr<float>((int) i);
+        double distance[2] = {0, 0};
+        for (int c = 0; c < 2; c++){
+            const float* center = centers.ptr<float>(c);
+            for (int b = 0; b < nBins; b++){
+                distance[c] += (hist[b] - center[b]) * (hist[b] - center[b]);
+            }
+            distance[c] = std::sqrt(distance[c]);
+        }
+        int c = clusters.at<int>((int) i);
+        colors[i].color = c == lightCluster ? 1 : -1;
+        double total = distance[0] + distance[1];
+        colors[i].confidence = total > 0 ? (distance[1 - c] - distance[c]) / total : 0;
+    }
+    return colors;
 }
@@ -1,10 +1,57 @@
 #ifndef PIECEDETECTOR_H
 #define PIECEDETECTOR_H
 
+#include <memory>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "board.h"
+#include "boardrectifier.h"
+#include "settings.h"
+
+// Finds the pieces of a whole board at once instead of square by square
 class PieceDetector
 {
 public:
-    PieceDetector();
+    enum Occupancy {EMPTY, OCCUPIED, UNCERTAIN};
+
+    struct PieceColor
+    {
+        int color; // 1 light, -1 dark, like the pieces in State
+        double confidence; // 0 on the border between the colours, 1 at a cluster centre
+    };
+
+    PieceDetector(const Board& board, Settings::PieceSettings settings = Settings::PieceSettings());
+
+    // Cheap occupancy test of every square from integral images of the gray level and
+    // the edges, inside the tile or the square's bounding box. Squares found empty are
+    // left out of the circle search.
+    void classifyOccupancy(const cv::Mat& gray);
+    const std::vector<Occupancy>& getOccupancy() const {return occupancy;}
+    double getSkippedFraction() const; // of the squares a piece can stand on
+
+    // Runs one HoughCircles per channel over the board and gives each circle to the black
+    // square its centre lies in. A square gets at most one circle, earlier channels first.
+    // Centres are relative to the square's tile when rectifying, otherwise to the square's
+    // bounding box like Square::detectPieceWithHough.
+    std::vector<std::pair<size_t, cv::Vec3i>> detectCircles(const std::vector<cv::Mat>& channels) const;
+
+    // Colour of all pieces in one call. The gray level histograms of the inner part of every
+    // circle are gathered in a single pass over a label image and split in two with 2-means.
+    // If the clusters are too close there is only one colour and the gray level decides.
+    std::vector<PieceColor> classifyColors(const cv::Mat& gray, const std::vector<std::pair<size_t, cv::Vec3i>>& circles) const;
+
+    bool isRectified() const {return rectifier.get() != 0;}
+
+private:
+    const Board& board;
+    Settings::PieceSettings settings;
+    std::shared_ptr<BoardRectifier> rectifier; // empty if the board is analysed in the image
+    cv::Rect region; // bounding box of the board in the image
+    double squareSize; // in the image, or the tile size
+    std::vector<Occupancy> occupancy; // empty until classifyOccupancy has run
+
+    bool canHoldPiece(size_t id) const;
+    bool assign(size_t id, std::vector<bool>& taken) const;
 };
 
 #endif // PIECEDETECTOR_H
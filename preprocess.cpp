@@ -1,11 +1,13 @@
 #include <opencv2/opencv.hpp>
 #include <vector>
+#include <algorithm>
 #include "preprocess.h"
-#include "Line.h"
+#include "line.h"
 #include "typedefs.h"
 #include "settings.h"
 #include "square.h"
 #include "global.h"
+#include "log.h"
 
 cv::Mat global::image_r, global::image_g, global::image_b, global::image_rgb_resized; // forward decleration;
 
@@ -21,6 +23,8 @@ Preprocess::Preprocess()
     global::image_r = global::channels[0];
     global::image_g = global::channels[1];
     global::image_b = global::channels[2];
+
+    regionRect = cv::Rect(0, 0, global::image.cols, global::image.rows);
 }
 
 void Preprocess::getLines(Lines& lines_){
@@ -45,6 +49,8 @@ void Preprocess::showHoughlines()
 void Preprocess::detectLines(Settings::PreprocessSettings settings_)
 {
     settings = settings_;
+    if (settings.proposeRegion && region.empty())
+        proposeBoardRegion(); // the image does not change between retries
     edgeDetection();
     lineDetection();
 }
@@ -62,24 +68,131 @@ cv::Mat Preprocess::getHough(){
     return imgHough;
 }
 
+void Preprocess::proposeBoardRegion()
+{
+    region.clear();
+    regionRect = cv::Rect(0, 0, global::image.cols, global::image.rows);
+
+    // The board only needs to be roughly located, so work on a heavily downsampled image
+    double scale = std::min(1.0, settings.proposalWidth / (double) global::image.cols);
+    cv::Mat small;
+    cv::resize(global::image, small, cv::Size(cvRound(global::image.cols * scale), cvRound(global::image.rows * scale)), 0, 0, cv::INTER_AREA);
+
+    // Checker texture energy. The squares give strong horizontal and vertical gradients close
+    // together, while edges of the table, hands and background mostly give one of them.
+    cv::Mat gx, gy, energy;
+    cv::Sobel(small, gx, CV_32F, 1, 0);
+    cv::Sobel(small, gy, CV_32F, 0, 1);
+    cv::multiply(gx, gy, energy);
+    cv::absdiff(energy, cv::Scalar::all(0), energy);
+    int ksize = std::max(3, small.cols / 16) | 1;
+    cv::boxFilter(energy, energy, -1, cv::Size(ksize, ksize));
+
+    double maxEnergy = 0;
+    cv::minMaxLoc(energy, 0, &maxEnergy);
+    if (maxEnergy <= 0)
+        return;
+
+    cv::Mat mask;
+    cv::threshold(energy, mask, maxEnergy * settings.proposalThreshold, 255, cv::THRESH_BINARY);
+    mask.convertTo(mask, CV_8U);
+
+    std::vector<std::vector<cv::Point> > contours;
+    cv::findContours(mask, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE);
+    if (contours.empty())
+        return;
+
+    size_t largest = 0;
+    double largestArea = 0;
+    for (size_t i = 0; i < contours.size(); i++){
+        double area = cv::contourArea(contours[i]);
+        if (area > largestArea){
+            largestArea = area;
+            largest = i;
+        }
+    }
+
+    // Bounding quadrilateral of the most textured blob
+    std::vector<cv::Point> hull, quad;
+    cv::convexHull(contours[largest], hull);
+    quad = hull;
+    double epsilon = 1;
+    for (int i = 0; i < 20 && quad.size() > 4; i++){
+        cv::approxPolyDP(hull, quad, epsilon, true);
+        epsilon *= 1.5;
+    }
+    if (quad.size() != 4){
+        cv::Point2f pts[4];
+        cv::minAreaRect(hull).points(pts);
+        quad.clear();
+        for (int i = 0; i < 4; i++){
+            quad.push_back(cv::Point(cvRound(pts[i].x), cvRound(pts[i].y)));
+        }
+    }
+
+    // Scale back to full size and pad, the outer lines of the board lie on the edge of the blob
+    cv::Point2d center(0, 0);
+    for (size_t i = 0; i < quad.size(); i++){
+        center += cv::Point2d(quad[i].x, quad[i].y) * 0.25;
+    }
+    for (size_t i = 0; i < quad.size(); i++){
+        cv::Point2d p = center + (cv::Point2d(quad[i].x, quad[i].y) - center) * (1 + settings.proposalPadding);
+        p = p * (1 / scale);
+        int x = std::max(0, std::min(global::image.cols - 1, cvRound(p.x)));
+        int y = std::max(0, std::min(global::image.rows - 1, cvRound(p.y)));
+        region.push_back(cv::Point(x, y));
+    }
+    regionRect = cv::boundingRect(region) & cv::Rect(0, 0, global::image.cols, global::image.rows);
+
+    // A tiny region is more likely clutter than a board, use the whole frame instead
+    if (regionRect.area() < 0.1 * global::image.cols * global::image.rows){
+        LOG_WARN("Board region proposal too small, using the whole image");
+        region.clear();
+        regionRect = cv::Rect(0, 0, global::image.cols, global::image.rows);
+        return;
+    }
+    LOG_INFO("Proposed board region: " << regionRect.x << "," << regionRect.y << " " << regionRect.width << "x" << regionRect.height);
+}
+
 void Preprocess::edgeDetection(bool doBlur){
 
+    // Only the proposed board region is blurred and searched for edges
     if (doBlur){
         //cv::GaussianBlur(gray, blurred, gaussianBlurSize, gaussianBlurSigma);
-        cv::GaussianBlur(global::image, blurred, settings.gaussianBlurSize, settings.gaussianBlurSigma);
+        global::image.copyTo(blurred);
+        cv::Mat blurredRegion = blurred(regionRect);
+        cv::GaussianBlur(global::image(regionRect), blurredRegion, settings.gaussianBlurSize, settings.gaussianBlurSigma);
     } else {
     blurred = global::image;
     }
-    cv::Canny(blurred, canny, settings.cannyLow, settings.cannyHigh, settings.cannySobel);
+
+    canny = cv::Mat::zeros(global::image.size(), CV_8UC1);
+    cv::Mat cannyRegion = canny(regionRect);
+    cv::Canny(blurred(regionRect), cannyRegion, settings.cannyLow, settings.cannyHigh, settings.cannySobel);
+
+    if (!region.empty()){ // drop edges outside the quadrilateral
+        std::vector<cv::Point> shifted(region.size());
+        for (size_t i = 0; i < region.size(); i++){
+            shifted[i] = region[i] - regionRect.tl();
+        }
+        cv::Mat mask = cv::Mat::zeros(regionRect.size(), CV_8UC1);
+        cv::fillConvexPoly(mask, shifted, cv::Scalar(255));
+        cv::bitwise_and(cannyRegion, mask, cannyRegion);
+    }
 }
 
 void Preprocess::lineDetection()
 {
-    /// Use Probabilistic Hough Transform
-    cv::HoughLinesP(canny, houghlines, 1, CV_PI/180, settings.houghThreshold, settings.minLineLength, settings.maxLineGap);
+    /// Use Probabilistic Hough Transform on the board region
+    cv::HoughLinesP(canny(regionRect), houghlines, 1, CV_PI/180, settings.houghThreshold, settings.minLineLength, settings.maxLineGap);
 
     for (size_t i = 0; i < houghlines.size(); i++)
     {
+        houghlines[i][0] += regionRect.x;
+        houghlines[i][1] += regionRect.y;
+        houghlines[i][2] += regionRect.x;
+        houghlines[i][3] += regionRect.y;
+
         cv::Point2d p1(houghlines[i][0], houghlines[i][1]);
         cv::Point2d p2(houghlines[i][2], houghlines[i][3]);
         if (cvutils::outOfBounds(global::image,p1) || cvutils::outOfBounds(global::image,p2))
@@ -88,4 +201,3 @@ void Preprocess::lineDetection()
         lines.push_back(l);
     }
 }
-
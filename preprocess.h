@@ -2,7 +2,7 @@
 #define PREPROCESS_H
 
 #include <opencv2/opencv.hpp>
-#include "Line.h"
+#include "line.h"
 #include "cvutils.h"
 #include "typedefs.h"
 #include "settings.h"
@@ -20,6 +20,8 @@ public:
     cv::Mat getCanny(){return canny;}
     cv::Mat getHough();
     cv::Mat getBlurred(){return blurred;}
+    std::vector<cv::Point> getRegion(){return region;}
+    cv::Rect getRegionRect(){return regionRect;}
 
 private:
     Settings::PreprocessSettings settings;
@@ -32,6 +34,9 @@ private:
     Lines lines;
     std::vector<cv::Vec4i> houghlines;
     cv::Mat blurred, canny, imgHough;
+    std::vector<cv::Point> region; // rough quadrilateral around the board, empty if not found
+    cv::Rect regionRect;
+    void proposeBoardRegion();
     void edgeDetection(bool doBlur = true);
     void lineDetection();
 };
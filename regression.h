@@ -3,7 +3,8 @@
 
 #include <vector>
 #include <iostream>
-#include "Line.h"
+#include "line.h"
+#include "log.h"
 
 template <class T>
 class Regression
@@ -35,11 +36,7 @@ public:
 
         line = Line(slope, yIntercept);
 
-        std::cout << "--------------" << std::endl;
-        std::cout << "Linear Regression" << std::endl;
-        std::cout << "Slope: " << slope << std::endl;
-        std::cout << "Interc: " << yIntercept << std::endl;
-        std::cout << "--------------" << std::endl;
+        LOG_TRACE("Linear regression, slope: " << slope << ", intercept: " << yIntercept);
 
     }
 
@@ -1,46 +1,188 @@
 #include "remover.h"
 #include "global.h"
 
-Remover::Remover(Board &board_) : matrix<size_t>(board_.getNumRows(), board_.getNumCols()), board(board_){
-    std::for_each(elements.begin(), elements.end(), [](size_t& element) {element = 0;});
+namespace {
+
+inline size_t popcount(uint64_t w){
+#if defined(__GNUC__)
+    return __builtin_popcountll(w);
+#else
+    size_t count = 0;
+    while (w){
+        w &= w - 1;
+        count++;
+    }
+    return count;
+#endif
 }
 
-std::vector<size_t> Remover::getCurrentRowRequests(){
-    std::vector<size_t> rowRequests;
-    std::vector<int> rowFlags;
-    for (size_t row = 0; row < board.getNumRows(); row++){
+inline uint64_t lowBits(size_t n){
+    return n >= 64 ? ~uint64_t(0) : (uint64_t(1) << n) - 1;
+}
 
-        std::vector<size_t> thisrow = this->getRow(row);
+} // end anonymous namespace
 
-        int sumVotes = std::count_if(thisrow.begin(), thisrow.end(), [](size_t i) {return i > 0;});
+Remover::Remover(Board &board_, double rowThreshold_, double colThreshold_) : board(board_){
+    nRows = board.getNumRows();
+    nCols = board.getNumCols();
+    if (nRows > maxSize || nCols > maxSize){
+        throw std::invalid_argument("Remover supports boards of at most " + std::to_string(maxSize) + " rows and columns");
+    }
+    rowThreshold = rowThreshold_;
+    colThreshold = colThreshold_;
+}
 
-        if (sumVotes / (double) nCols > 0.5){
-            rowRequests.push_back(row);
-            rowFlags.push_back(1);
-        } else {
-            rowFlags.push_back(0);
+size_t Remover::addFilter(const std::string& name, double rowThreshold_, double colThreshold_){
+    int existing = findFilter(name);
+    if (existing != allFilters){
+        return existing;
+    }
+
+    Filter filter;
+    filter.name = name;
+    filter.rowThreshold = rowThreshold_;
+    filter.colThreshold = colThreshold_;
+    filter.rowBits.assign(nRows, 0);
+    filter.colBits.assign(nCols, 0);
+    filters.push_back(filter);
+    return filters.size() - 1;
+}
+
+int Remover::findFilter(const std::string& name) const{
+    for (size_t i = 0; i < filters.size(); i++){
+        if (filters[i].name == name)
+            return (int) i;
+    }
+    return allFilters;
+}
+
+void Remover::vote(size_t filter, size_t row, size_t col){
+    if (row >= nRows || col >= nCols){
+        throw std::out_of_range("Out of range!");
+    }
+    Filter& f = filters.at(filter);
+    f.rowBits[row] |= uint64_t(1) << col;
+    f.colBits[col] |= uint64_t(1) << row;
+}
+
+void Remover::voteRow(size_t filter, size_t row, const std::vector<size_t>& votes){
+    if (votes.size() != nCols){
+        throw std::out_of_range("Row must be of length " + std::to_string(nCols));
+    }
+    for (size_t col = 0; col < nCols; col++){
+        if (votes[col] > 0)
+            vote(filter, row, col);
+    }
+}
+
+void Remover::voteCol(size_t filter, size_t col, const std::vector<size_t>& votes){
+    if (votes.size() != nRows){
+        throw std::out_of_range("Col must be of length " + std::to_string(nRows));
+    }
+    for (size_t row = 0; row < nRows; row++){
+        if (votes[row] > 0)
+            vote(filter, row, col);
+    }
+}
+
+uint64_t Remover::rowWord(size_t row, int filter) const{
+    if (filter != allFilters){
+        return filters.at(filter).rowBits.at(row);
+    }
+    uint64_t w = 0;
+    for (size_t i = 0; i < filters.size(); i++){
+        w |= filters[i].rowBits.at(row);
+    }
+    return w;
+}
+
+uint64_t Remover::colWord(size_t col, int filter) const{
+    if (filter != allFilters){
+        return filters.at(filter).colBits.at(col);
+    }
+    uint64_t w = 0;
+    for (size_t i = 0; i < filters.size(); i++){
+        w |= filters[i].colBits.at(col);
+    }
+    return w;
+}
+
+size_t Remover::countRowVotes(size_t row, int filter) const{
+    return popcount(rowWord(row, filter));
+}
+
+size_t Remover::countColVotes(size_t col, int filter) const{
+    return popcount(colWord(col, filter));
+}
+
+std::vector<std::pair<std::string, size_t> > Remover::getRowBreakdown(size_t row) const{
+    std::vector<std::pair<std::string, size_t> > breakdown;
+    for (size_t i = 0; i < filters.size(); i++){
+        breakdown.push_back(std::make_pair(filters[i].name, popcount(filters[i].rowBits.at(row))));
+    }
+    return breakdown;
+}
+
+std::vector<std::pair<std::string, size_t> > Remover::getColBreakdown(size_t col) const{
+    std::vector<std::pair<std::string, size_t> > breakdown;
+    for (size_t i = 0; i < filters.size(); i++){
+        breakdown.push_back(std::make_pair(filters[i].name, popcount(filters[i].colBits.at(col))));
+    }
+    return breakdown;
+}
+
+std::vector<size_t> Remover::getCurrentRowRequests() const{
+    std::vector<size_t> rowRequests;
+    for (size_t row = 0; row < nRows; row++){
+        bool request = countRowVotes(row) / (double) nCols > rowThreshold;
+        for (size_t i = 0; i < filters.size() && !request; i++){
+            request = popcount(filters[i].rowBits[row]) / (double) nCols > filters[i].rowThreshold;
         }
+        if (request)
+            rowRequests.push_back(row);
     }
     return rowRequests;
 }
 
-std::vector<size_t> Remover::getCurrentColRequests(){
+std::vector<size_t> Remover::getCurrentColRequests() const{
     std::vector<size_t> colRequests;
-    std::vector<int> colFlags;
-
-    for (size_t col = 0; col < board.getNumCols(); col++){
-        std::vector<size_t> thiscol = getCol(col);
-        size_t sumVotes = std::count_if(thiscol.begin(), thiscol.end(), [](size_t i) {return i > 0;});
-
-        if (sumVotes / (double) nRows > 0.9){
+    for (size_t col = 0; col < nCols; col++){
+        bool request = countColVotes(col) / (double) nRows > colThreshold;
+        for (size_t i = 0; i < filters.size() && !request; i++){
+            request = popcount(filters[i].colBits[col]) / (double) nRows > filters[i].colThreshold;
+        }
+        if (request)
             colRequests.push_back(col);
-            colFlags.push_back(1);
-        } else {
-            colFlags.push_back(0);
+    }
+    return colRequests;
+}
+
+void Remover::removeRows(size_t nTop, size_t nBottom){
+    if (nTop + nBottom == 0)
+        return;
+    nRows -= nTop + nBottom;
+    for (size_t i = 0; i < filters.size(); i++){
+        Filter& f = filters[i];
+        f.rowBits.erase(f.rowBits.end() - nBottom, f.rowBits.end());
+        f.rowBits.erase(f.rowBits.begin(), f.rowBits.begin() + nTop);
+        for (size_t col = 0; col < nCols; col++){
+            f.colBits[col] = (f.colBits[col] >> nTop) & lowBits(nRows);
         }
     }
+}
 
-    return colRequests;
+void Remover::removeCols(size_t nLeft, size_t nRight){
+    if (nLeft + nRight == 0)
+        return;
+    nCols -= nLeft + nRight;
+    for (size_t i = 0; i < filters.size(); i++){
+        Filter& f = filters[i];
+        f.colBits.erase(f.colBits.end() - nRight, f.colBits.end());
+        f.colBits.erase(f.colBits.begin(), f.colBits.begin() + nLeft);
+        for (size_t row = 0; row < nRows; row++){
+            f.rowBits[row] = (f.rowBits[row] >> nLeft) & lowBits(nCols);
+        }
+    }
 }
 
 void Remover::remove(){
@@ -50,13 +192,23 @@ void Remover::remove(){
     // Any not at the edge?
     // TODO
 
-    // Request removals from board
+    // Request removals from board, the board only removes runs of rows and columns at its edges
     if (!rowRequests.empty()){
+        size_t before = board.getNumRows();
         board.removeRowsRequest(rowRequests);
-        this->removeRowsRequest(rowRequests);
+        size_t removed = before - board.getNumRows();
+        size_t nTop = 0;
+        while (nTop < removed && rowRequests[nTop] == nTop)
+            nTop++;
+        removeRows(nTop, removed - nTop);
     }
     if (!colRequests.empty()){
+        size_t before = board.getNumCols();
         board.removeColsRequest(colRequests);
-        this->removeColsRequest(colRequests);
+        size_t removed = before - board.getNumCols();
+        size_t nLeft = 0;
+        while (nLeft < removed && colRequests[nLeft] == nLeft)
+            nLeft++;
+        removeCols(nLeft, removed - nLeft);
     }
 }
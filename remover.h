@@ -1,24 +1,76 @@
 #ifndef REMOVER_H
 #define REMOVER_H
 
+#include <cstdint>
+#include <string>
+#include <utility>
 #include <vector>
-#include <numeric>
 
-#include "matrix.h"
 #include "board.h"
 
-class Remover : public matrix<size_t>
+// Collects votes of the board filters on squares that should go and removes the rows and
+// columns with too many votes from the board. Every filter votes on its own bit plane, stored
+// once per row and once per column in 64 bit words, so counting the votes in a row or column
+// is a popcount and the per filter breakdown comes for free.
+//
+// A row (column) is requested for removal when more than rowThreshold (colThreshold) of its
+// squares got a vote from any filter, or more than the filter's own threshold got a vote from
+// that filter alone.
+class Remover
 {
 public:
-    Remover(Board &board_);
+    static const size_t maxSize = 64; // rows and columns of the board, one word per row and column
+    static const int allFilters = -1;
 
-    std::vector<size_t> getCurrentRowRequests();
-    std::vector<size_t> getCurrentColRequests();
+    Remover(Board &board_, double rowThreshold = 0.5, double colThreshold = 0.9);
+
+    // Returns the id of the filter with this name, registering it on first use. Thresholds
+    // above 1 mean the filter only counts towards the combined vote.
+    size_t addFilter(const std::string& name, double rowThreshold = 2, double colThreshold = 2);
+    int findFilter(const std::string& name) const;
+    const std::string& getFilterName(size_t filter) const {return filters.at(filter).name;}
+    size_t getNumFilters() const {return filters.size();}
+
+    // Votes, nonzero entries of votes are votes for the square in that column (row)
+    void vote(size_t filter, size_t row, size_t col);
+    void voteRow(size_t filter, size_t row, const std::vector<size_t>& votes);
+    void voteCol(size_t filter, size_t col, const std::vector<size_t>& votes);
+
+    // Number of voted squares in a row or column, by one filter or by any of them
+    size_t countRowVotes(size_t row, int filter = allFilters) const;
+    size_t countColVotes(size_t col, int filter = allFilters) const;
+
+    // Votes of each filter, in the order the filters were added
+    std::vector<std::pair<std::string, size_t> > getRowBreakdown(size_t row) const;
+    std::vector<std::pair<std::string, size_t> > getColBreakdown(size_t col) const;
+
+    std::vector<size_t> getCurrentRowRequests() const;
+    std::vector<size_t> getCurrentColRequests() const;
     void remove();
 
+    size_t getNumRows() const {return nRows;}
+    size_t getNumCols() const {return nCols;}
+
 private:
+    struct Filter
+    {
+        std::string name;
+        double rowThreshold, colThreshold;
+        std::vector<uint64_t> rowBits; // bit col of word row
+        std::vector<uint64_t> colBits; // bit row of word col
+    };
+
     Board& board;
+    size_t nRows;
+    size_t nCols;
+    double rowThreshold;
+    double colThreshold;
+    std::vector<Filter> filters;
 
+    uint64_t rowWord(size_t row, int filter) const;
+    uint64_t colWord(size_t col, int filter) const;
+    void removeRows(size_t nTop, size_t nBottom);
+    void removeCols(size_t nLeft, size_t nRight);
 };
 
 #endif // REMOVER_H
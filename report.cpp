@@ -1,2 +1,83 @@
+#include <cstdio>
+#include <fstream>
 #include "report.h"
+#include "log.h"
 
+void Report::reset(){
+    frame = 0;
+    squaresCreated = 0;
+    squaresClassified = 0;
+    retries = 0;
+    expansions = 0;
+    confidence = 0;
+    detected = false;
+    nTimings = 0;
+    nLineCounts = 0;
+}
+
+void Report::addTiming(const char* stage, double ms){
+    if (nTimings < maxEntries){
+        timings[nTimings].stage = stage;
+        timings[nTimings].ms = ms;
+        nTimings++;
+    }
+}
+
+void Report::addLineCount(const char* filter, size_t before, size_t after){
+    if (nLineCounts < maxEntries){
+        lineCounts[nLineCounts].filter = filter;
+        lineCounts[nLineCounts].before = before;
+        lineCounts[nLineCounts].after = after;
+        nLineCounts++;
+    }
+}
+
+double Report::getTotalMs() const{
+    double total = 0;
+    for (size_t i = 0; i < nTimings; i++){
+        total += timings[i].ms;
+    }
+    return total;
+}
+
+std::string Report::toJson() const{
+    char buf[128];
+    std::string json;
+    json.reserve(512);
+
+    snprintf(buf, sizeof(buf), "{\"frame\":%zu,\"time\":\"", frame);
+    json += buf;
+    json += utils::currentDateTime();
+    json += "\",\"stages\":{";
+    for (size_t i = 0; i < nTimings; i++){
+        snprintf(buf, sizeof(buf), "%s\"%s\":%.3f", i > 0 ? "," : "", timings[i].stage, timings[i].ms);
+        json += buf;
+    }
+    snprintf(buf, sizeof(buf), "},\"totalMs\":%.3f,\"lines\":[", getTotalMs());
+    json += buf;
+    for (size_t i = 0; i < nLineCounts; i++){
+        snprintf(buf, sizeof(buf), "%s{\"filter\":\"%s\",\"before\":%zu,\"after\":%zu}",
+                 i > 0 ? "," : "", lineCounts[i].filter, lineCounts[i].before, lineCounts[i].after);
+        json += buf;
+    }
+    snprintf(buf, sizeof(buf), "],\"squaresCreated\":%zu,\"squaresClassified\":%zu,\"retries\":%d,\"expansions\":%d,",
+             squaresCreated, squaresClassified, retries, expansions);
+    json += buf;
+    snprintf(buf, sizeof(buf), "\"confidence\":%.4f,\"detected\":%s}", confidence, detected ? "true" : "false");
+    json += buf;
+    return json;
+}
+
+void Report::appendTo(std::ostream& os) const{
+    os << toJson() << '\n';
+}
+
+bool Report::appendTo(const std::string& path) const{
+    std::ofstream file(path.c_str(), std::ios::app);
+    if (!file){
+        LOG_WARN("Could not open report " << path);
+        return false;
+    }
+    appendTo(file);
+    return true;
+}
@@ -1,23 +1,71 @@
 #ifndef REPORT_H
 #define REPORT_H
 
+#include <cstddef>
+#include <ostream>
 #include <string>
-#include <vector>
+#include <opencv2/opencv.hpp>
 #include "utils.h"
 
+// What happened to one frame on its way through the detection: how long each stage took,
+// how many Hough lines every filter let through, how many squares were built and classified,
+// how often the detection was retried and the board expanded, and how sure it is of the
+// result. Filling it in only stores numbers in fixed size arrays, so it never allocates and
+// can stay on for every frame. toJson() gives the record as a single JSON line.
 class Report
 {
 public:
-    Report(){
-        //filename = "Report_" + utils::currentDateTime();
-    }
-    std::string filename;
+    static const size_t maxEntries = 16; // stages and line filters, later ones are dropped
 
-    // Filter by size
-    std::vector<int> vlengths, hlengths, rowtypes, coltypes;
-    std::vector<int> slopes; // filtering vlengths
-    std::vector<int> yIntercepts; // filtering vlengths
+    struct Timing {const char* stage; double ms;};
+    struct LineCount {const char* filter; size_t before, after;};
 
+    // Measures the wall time from construction to destruction as one stage
+    class StageTimer
+    {
+    public:
+        StageTimer(Report& report_, const char* stage_)
+            : report(report_), stage(stage_), start(static_cast<double>(cv::getTickCount())) {}
+        ~StageTimer(){
+            double duration = (static_cast<double>(cv::getTickCount()) - start) / cv::getTickFrequency();
+            report.addTiming(stage, duration * 1000);
+        }
+    private:
+        Report& report;
+        const char* stage;
+        double start;
+    };
+
+    Report(){reset();}
+    void reset();
+
+    // Stage and filter names must be string literals, only the pointer is kept
+    void addTiming(const char* stage, double ms);
+    void addLineCount(const char* filter, size_t before, size_t after);
+
+    size_t getNumTimings() const {return nTimings;}
+    const Timing& getTiming(size_t i) const {return timings[i];}
+    size_t getNumLineCounts() const {return nLineCounts;}
+    const LineCount& getLineCount(size_t i) const {return lineCounts[i];}
+    double getTotalMs() const;
+
+    std::string toJson() const;
+    void appendTo(std::ostream& os) const;     // one JSON line
+    bool appendTo(const std::string& path) const; // false if the file could not be opened
+
+    size_t frame;
+    size_t squaresCreated;
+    size_t squaresClassified;
+    int retries;
+    int expansions;
+    double confidence; // fraction of the board's squares with the expected type, 0 to 1
+    bool detected;
+
+private:
+    Timing timings[maxEntries];
+    LineCount lineCounts[maxEntries];
+    size_t nTimings;
+    size_t nLineCounts;
 };
 
 #endif // REPORT_H
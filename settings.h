@@ -8,6 +8,9 @@ namespace Settings{
 struct PreprocessSettings{
     int houghThreshold, minLineLength, maxLineGap, gaussianBlurSigma, cannyLow, cannyHigh, cannySobel;
     cv::Size gaussianBlurSize;
+    bool proposeRegion;
+    int proposalWidth;
+    double proposalThreshold, proposalPadding;
 
     PreprocessSettings(){
         houghThreshold = 96;
@@ -19,6 +22,71 @@ struct PreprocessSettings{
         cannyLow = 30;
         cannyHigh = 200;
         cannySobel = 3;
+        proposeRegion = true;
+        proposalWidth = 128; // width of the downsampled image the board region is searched in
+        proposalThreshold = 0.2; // fraction of the strongest checker texture that counts as board
+        proposalPadding = 0.15;
+    }
+};
+
+struct PieceSettings{
+    bool boardWideCircles, rectify, preclassify;
+    int tileSize;
+    double minPieceRadius, maxPieceRadius, minPieceDistance, blurSigma;
+    double emptyMaxStdDev, emptyMaxEdgeDensity, emptyMaxColorDeviation;
+    double occupiedMinStdDev, occupiedMinEdgeDensity, occupiedMinColorDeviation;
+    int cannyHigh, accumulatorThreshold, colorBins;
+    double pieceMaskRadius, minColorSeparation;
+
+    PieceSettings(){
+        boardWideCircles = true; // one HoughCircles per channel over the whole board instead of one per square
+        rectify = true; // work on top-down tiles warped with the board homography
+        tileSize = 64;
+        minPieceRadius = 0.2; // relative to the square size
+        maxPieceRadius = 0.6;
+        minPieceDistance = 0.8;
+        blurSigma = 1.5;
+        cannyHigh = 60; // upper Canny threshold inside HoughCircles
+        accumulatorThreshold = 20;
+        colorBins = 16; // gray level histogram of each piece
+        pieceMaskRadius = 0.6; // part of the circle the colour is taken from
+        minColorSeparation = 40; // gray levels between the clusters for both colours to be present
+        preclassify = true; // skip the circle search on squares that are clearly empty
+        emptyMaxStdDev = 12; // a square is empty if it is flat, has few edges and has the colour of its neighbours
+        emptyMaxEdgeDensity = 0.02;
+        emptyMaxColorDeviation = 20;
+        occupiedMinStdDev = 25; // and occupied if any of them is clearly off, otherwise uncertain
+        occupiedMinEdgeDensity = 0.08;
+        occupiedMinColorDeviation = 40;
+    }
+};
+
+struct BoardSettings{
+    bool refineCorners, refitLines, windowSearch;
+    int refineRadius, refineIterations, refitBand;
+    double minClusterSeparation, maxClusterDeviation, duplicateFraction, minDuplicateDistance;
+    int minCornerRadius, maxCornerRadius, cornerRings;
+    double cornerRadiusFraction;
+    double removeRowFraction, removeColFraction;
+    PieceSettings pieces;
+
+    BoardSettings(){
+        refineCorners = true;
+        windowSearch = true; // pick the best 8x8 window of the candidate grid instead of pruning and filtering it
+        refineRadius = 5; // half size of the window the saddle point is fitted in
+        refineIterations = 3;
+        refitLines = true;
+        refitBand = 3; // edge pixels at most this far from a line are used to refit it
+        minClusterSeparation = 30; // degrees between the horizontal and vertical line directions
+        maxClusterDeviation = 45; // lines further than this from both directions are ignored
+        duplicateFraction = 0.25; // lines closer than this fraction of the square size are duplicates
+        minDuplicateDistance = 3;
+        cornerRadiusFraction = 0.15; // corner patch radius relative to the local square size
+        minCornerRadius = 4;
+        maxCornerRadius = 32; // at most Corner::maxRadius
+        cornerRings = 4; // rings voted on per corner, bounds the cost of classifying a corner
+        removeRowFraction = 0.5; // rows with more voted squares than this are removed
+        removeColFraction = 0.9;
     }
 };
 
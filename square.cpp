@@ -1,148 +1,179 @@
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 #include <opencv2/opencv.hpp>
 #include "square.h"
-#include "Line.h"
+#include "line.h"
 #include "global.h"
+#include "log.h"
 
 extern bool global::doDraw;
 
+CornerCache Square::cornerCache;
+std::atomic<size_t> Square::nCreated(0);
+std::atomic<size_t> Square::nClassified(0);
+
+namespace {
+
+const int defaultCornerRadius = 10; // used when the caller has no estimate of the square size
+
+// Same order as cvutils::sortSquareCorners, but in place. The radii follow their corners.
+void sortCorners(cv::Point2d* points, int* radii)
+{
+    int order[4] = {0, 1, 2, 3};
+    std::sort(order, order + 4, [&] (int a, int b){return points[a].y < points[b].y;});
+    if (!(points[order[0]].x < points[order[1]].x))
+        std::swap(order[0], order[1]);
+    if (!(points[order[2]].x > points[order[3]].x))
+        std::swap(order[2], order[3]);
+
+    cv::Point2d sortedPoints[4];
+    int sortedRadii[4];
+    for (int i = 0; i < 4; i++){
+        sortedPoints[i] = points[order[i]];
+        sortedRadii[i] = radii[order[i]];
+    }
+    std::copy(sortedPoints, sortedPoints + 4, points);
+    std::copy(sortedRadii, sortedRadii + 4, radii);
+}
+
+} // end anonymous namespace
+
 // S Q U A R E
 Square::Square(){
-    squareTypeDetermined = false;
-    outOfBounds = false;
-    containsPieceDetermined = false;
-    doesContainPiece = false;
+    std::memset(&geom, 0, sizeof(geom));
 }
 
-Square::Square(cv::Point2d corner1, cv::Point2d corner2, cv::Point2d corner3, cv::Point2d corner4)
+Square::Square(cv::Point2d corner1, cv::Point2d corner2, cv::Point2d corner3, cv::Point2d corner4, cv::Vec4i cornerRadii)
 {
-    cv::Size imsize = global::image.size();
-
-    squareTypeDetermined = false;
-    outOfBounds = false;
-    containsPieceDetermined = false;
-    doesContainPiece = false;
+    std::memset(&geom, 0, sizeof(geom));
 
-    Points2d cp{corner1, corner2, corner3, corner4};
-    bool negCoord = cvutils::anyNegCoordinate(cp);
-    if (negCoord){
-        throw std::invalid_argument("One of the points has a negative coordinate");
+    cv::Point2d cp[4] = {corner1, corner2, corner3, corner4};
+    int radii[4];
+    for (int i = 0; i < 4; i++){
+        if (cp[i].x < 0 || cp[i].y < 0){
+            throw std::invalid_argument("One of the points has a negative coordinate");
+        }
+        if (cornerRadii[i] < 0 || cornerRadii[i] > Corner::maxRadius){
+            throw std::invalid_argument("Corner radius must be between 0 and " + std::to_string(Corner::maxRadius));
+        }
+        radii[i] = cornerRadii[i] > 0 ? cornerRadii[i] : defaultCornerRadius;
     }
 
-    cornerpoints = cp;
-
-    cornerpointsSorted = cvutils::sortSquareCorners(cornerpoints);
-
-    upperLeft = cornerpointsSorted[0];
-    upperRight = cornerpointsSorted[1];
-    lowerRight = cornerpointsSorted[2];
-    lowerLeft = cornerpointsSorted[3];
+    sortCorners(cp, radii);
+    for (int i = 0; i < 4; i++){
+        geom.x[i] = cp[i].x;
+        geom.y[i] = cp[i].y;
+        geom.radius[i] = (unsigned char) radii[i];
+        geom.cx += cp[i].x / 4;
+        geom.cy += cp[i].y / 4;
+    }
 
-    center = cvutils::centerpoint(cornerpointsSorted);
+    const cv::Point2d& upperLeft = cp[0];
+    const cv::Point2d& upperRight = cp[1];
+    const cv::Point2d& lowerRight = cp[2];
+    const cv::Point2d& lowerLeft = cp[3];
 
-    upperLeft.x < lowerLeft.x ? firstx = upperLeft.x : firstx = lowerLeft.x;
-    upperLeft.y < lowerLeft.y ? firsty = upperLeft.y : firsty = lowerLeft.y;
-    upperRight.x > lowerRight.x ? lastx = upperRight.x : lastx = lowerRight.x;
-    upperRight.y > lowerRight.y ? lasty = upperRight.y : lasty = lowerRight.y;
+    double firstx = std::min(upperLeft.x, lowerLeft.x);
+    double firsty = std::min(upperLeft.y, lowerLeft.y);
+    double lastx = std::max(upperRight.x, lowerRight.x);
+    double lasty = std::max(upperRight.y, lowerRight.y);
+    geom.bx = (int) firstx;
+    geom.by = (int) firsty;
+    geom.bw = (int) (lastx - firstx);
+    geom.bh = (int) (lasty - firsty);
 
     try{
-        area = global::image(cv::Rect(firstx, firsty, lastx-firstx, lasty-firsty));
-
-        meanGray = calcMeanGray(area);
+        geom.meanGray = (short) calcMeanGray(getArea());
     } catch(std::exception &e){
-        outOfBounds = true;
+        geom.flags |= SquareGeom::OUT_OF_BOUNDS;
     }
 
-    //////////
-    hlength = cv::norm(upperRight-upperLeft);
-    vlength = cv::norm(upperLeft - lowerLeft);
-
-    calcBorders();
-    //calcVanishingPoints();
-
     if (!global::image.data){
         throw std::invalid_argument("global::image is empty, cannot create corners.");
-    } else if (!outOfBounds) {
-        createCorners(global::image);
     }
+
+    // Corners are only classified when the type is asked for, but a square whose
+    // corner patches leave the image is known to be out of bounds right away
+    for (size_t i = 0; i < 4 && !isOutOfBounds(); i++){
+        if (Corner::isOutOfBounds(global::image, getCornerpoint(i), geom.radius[i]))
+            geom.flags |= SquareGeom::OUT_OF_BOUNDS;
+    }
+    nCreated++;
 }
 
-size_t Square::getVLength(){return vlength;}
-size_t Square::getHLength(){return hlength;}
+int Square::getSquareType() const
+{
+    if (!(geom.flags & SquareGeom::TYPE_DETERMINED))
+        classify();
+    return geom.squareType;
+}
 
-int Square::getMeanGray()
+void Square::classify() const
 {
-    return meanGray;
+    if (!isOutOfBounds()){
+        createCorners();
+        nClassified++;
+    }
+    if (!isOutOfBounds()){
+        determineType();
+    } else {
+        geom.squareType = 0;
+        geom.flags |= SquareGeom::TYPE_DETERMINED;
+    }
 }
 
-Points2d Square::getCornerpoints(){
-    return cornerpoints;
+size_t Square::getVLength() const {return (int) cv::norm(getCornerpoint(0) - getCornerpoint(3));}
+size_t Square::getHLength() const {return (int) cv::norm(getCornerpoint(1) - getCornerpoint(0));}
+
+cv::Mat Square::getArea() const
+{
+    return global::image(getBounds());
 }
 
-void Square::determineType()
+void Square::determineType() const
 {
-    if (corners.empty()){
-        std::cout << "Corners have not been added yet" << std::endl;
+    if (!(geom.flags & SquareGeom::CORNERS_CREATED)){
+        LOG_WARN("Corners have not been added yet");
         return;
     }
 
-    std::vector<int> votes(4);
-    for (int i = 0; i < 4; i++){
-        votes.at(i) = corners[i].getNRegions();
-    }
-
-    std::vector<int> histogram(6,0); // votes can be 0 (undertermined), 1, 2, 3, 4, or 5 (more than 4)
-    for( int i=0; i< (int) votes.size(); ++i )
-        ++histogram[ votes[i] ];
-
-    //int vote = std::max_element( histogram.begin(), histogram.end() ) - histogram.begin();
+    int histogram[6] = {0, 0, 0, 0, 0, 0}; // votes can be 0 (undertermined), 1, 2, 3, 4, or 5 (more than 4)
+    for (int i = 0; i < 4; i++)
+        ++histogram[ geom.nRegions[i] ];
 
     // inner 4, border 3, corner 2, frame 1, outside board 0
     if (histogram[4] >= 3){
-        squareType = 4;
+        geom.squareType = 4;
     }
 
     else if (histogram[4] == 2 && histogram[2] == 2){
-        squareType = 3;
+        geom.squareType = 3;
     }
 
     else if (histogram[4] == 1 && histogram[2] >= 2){
-        squareType = 2;
+        geom.squareType = 2;
     }
 
     else {
-        squareType = 0;
+        geom.squareType = 0;
     }
 
-    squareTypeDetermined = true;
+    geom.flags |= SquareGeom::TYPE_DETERMINED;
 }
 
 bool Square::containsPoint(cv::Point2d point) const {
-    /*
-        double test1 = upperBorder.ylookup(point.x);
-        double test2 = lowerBorder.ylookup(point.x);
-        double test3 = leftBorder.xlookup(point.y);
-        double test4 = rightBorder.xlookup(point.y);
-        */
-    bool belowTop = point.y > upperBorder.ylookup(point.x);
-    bool aboveBottom = point.y < lowerBorder.ylookup(point.x);
-    bool rightofLeft = point.x > leftBorder.xlookup(point.y);
-    bool leftofRight = point.x < rightBorder.xlookup(point.y);
-
-    return (belowTop && aboveBottom && rightofLeft && leftofRight);
-}
-
-void Square::calcBorders()
-{
-    leftBorder = Line(cornerpointsSorted.at(3),cornerpointsSorted.at(0));
-    upperBorder = Line(cornerpointsSorted.at(0),cornerpointsSorted.at(1));
-    rightBorder = Line(cornerpointsSorted.at(1),cornerpointsSorted.at(2));
-    lowerBorder = Line(cornerpointsSorted.at(2),cornerpointsSorted.at(3));
-    Lines bds{leftBorder, upperBorder, rightBorder, lowerBorder};
-    borders = bds;
+    // inside if the point is to the right of every border walked clockwise
+    for (int i = 0; i < 4; i++){
+        int j = (i + 1) % 4;
+        double cross = (geom.x[j] - geom.x[i]) * (point.y - geom.y[i]) - (geom.y[j] - geom.y[i]) * (point.x - geom.x[i]);
+        if (cross <= 0)
+            return false;
+    }
+    return true;
 }
 
-int Square::calcMeanGray(cv::Mat& area)
+int Square::calcMeanGray(const cv::Mat& area)
 {
     int n = 0;
     int val = 0;
@@ -154,56 +185,36 @@ int Square::calcMeanGray(cv::Mat& area)
             n += 1;
         }
     }
-    meanGray = 0;
+    int meanGray = 0;
     if (n > 0){
         meanGray = val / n;
     }
     return meanGray;
 }
 
-void Square::calcVanishingPoints()
-{
-    Line border1 = borders.at(0);
-    Line border2 = borders.at(1);
-    Line border3 = borders.at(2);
-    Line border4 = borders.at(3);
-
-    cv::Point2d p1, p2;
-    border1.Intersection(border3, p1);
-    border2.Intersection(border4, p2);
-
-    vanishingPoints.push_back(p1);
-    vanishingPoints.push_back(p2);
-}
-
 void Square::draw() const{
-
-
-    // TODO make dynamic
-    cv::Mat im = cv::Mat::zeros(2,imsize,CV_8UC3);
-    cv::line( im, borders[0].points[0], borders[0].points[1],cv::Scalar( 110, 220, 0 ),  2, 8 );
-    cv::line( im, borders[1].points[0], borders[1].points[1],cv::Scalar( 110, 220, 0 ),  2, 8 );
-    cv::line( im, borders[2].points[0], borders[2].points[1],cv::Scalar( 110, 220, 0 ),  2, 8 );
-    cv::line( im, borders[3].points[0], borders[3].points[1],cv::Scalar( 110, 220, 0 ),  2, 8 );
+    cv::Mat im = cv::Mat::zeros(global::image.size(), CV_8UC3);
+    Lines borders = getBordersSorted();
+    for (size_t i = 0; i < borders.size(); i++){
+        cv::line( im, borders[i].points[0], borders[i].points[1],cv::Scalar( 110, 220, 0 ),  2, 8 );
+    }
 
     cv::namedWindow("Square");
     cv::imshow("Square",im);
 
     cv::waitKey( 0 );
-
-
 }
 
 void Square::drawOnImg(cv::Mat& image) const
 {
-
+    Points2d cornerpointsSorted = getCornerpointsSorted();
     if (cvutils::anyNegCoordinate(cornerpointsSorted)){
-        std::cout << "At least one point has a negative index, cannot draw" << std::endl;
+        LOG_WARN("At least one point has a negative index, cannot draw");
         return;
     }
 
-    if (outOfBounds){
-        std::cout << "Square is fully or partially outside of the global::image, cannot draw" << std::endl;
+    if (isOutOfBounds()){
+        LOG_WARN("Square is fully or partially outside of the global::image, cannot draw");
         return;
     }
 
@@ -217,14 +228,14 @@ void Square::drawOnImg(cv::Mat& image) const
 
 bool Square::detectPieceWithHough(cv::Vec3i &circle){
     cv::Mat binarea;
-    cv::threshold(area, binarea, meanGray, 255, 0);
+    cv::threshold(getArea(), binarea, geom.meanGray, 255, 0);
 
     std::vector<cv::Vec3f> circles;
     cv::HoughCircles(binarea, circles, CV_HOUGH_GRADIENT, 1, binarea.rows, 20, 15, binarea.rows*0.3, binarea.rows*1.5);
 
     if (circles.size() > 0){
         circle = circles[0]; // todo use diagnostics to choose the best circle if there are more than 1
-        doesContainPiece = true;
+        geom.flags |= SquareGeom::CONTAINS_PIECE;
         return true;
     }
     return false;
@@ -234,10 +245,10 @@ bool Square::detectPieceWithHough(cv::Mat &image_channel, cv::Vec3i &circle){
     cv::Mat binarea, channelArea;
 
     try{
-        channelArea = image_channel(cv::Rect(firstx, firsty, lastx-firstx, lasty-firsty));
+        channelArea = image_channel(getBounds());
         cv::GaussianBlur(channelArea, channelArea, cv::Size(1,1), 1);
     } catch(std::exception& e){
-        std::cout << "image channel error" << std::endl;
+        LOG_WARN("image channel error");
     }
     int channelMeanGray =  calcMeanGray(channelArea);
     int thresh = channelMeanGray * 1.15;
@@ -258,7 +269,7 @@ bool Square::detectPieceWithHough(cv::Mat &image_channel, cv::Vec3i &circle){
     try{
         cv::HoughCircles(binarea, circles, CV_HOUGH_GRADIENT, 1, binarea.rows, 20, 15, binarea.rows*0.1, binarea.rows*3);
     } catch(std::exception &e){
-        std::cout << "HoughCircles error" << std::endl;
+        LOG_WARN("HoughCircles error");
     }
 
     if (circles.size() > 0){
@@ -268,21 +279,22 @@ bool Square::detectPieceWithHough(cv::Mat &image_channel, cv::Vec3i &circle){
             cv::circle(channelArea, cv::Point(circle[0], circle[1]), circle[2], cv::Scalar(255,0,0));
 
         } catch(std::exception& e){
-            std::cout << "circle error" << std::endl;
+            LOG_WARN("circle error");
         }
 
         //if (global::doDraw) cv::imshow("circle", channelArea); cv::waitKey();
-        doesContainPiece = true;
+        geom.flags |= SquareGeom::CONTAINS_PIECE;
         return true;
     }
     return false;
 }
 
 bool Square::determinePieceColor(cv::Vec3i circle, int& color) const{
+    cv::Mat area = getArea();
     int x = circle[0];
     int y = circle[1];
-    int vsize = vlength/3;
-    int hsize = hlength/3;
+    int vsize = getVLength()/3;
+    int hsize = getHLength()/3;
     cv::Mat subarea;
 
     int upperx = x - hsize;
@@ -300,7 +312,7 @@ bool Square::determinePieceColor(cv::Vec3i circle, int& color) const{
     try{
         subarea = area(cv::Rect(upperx, uppery, hsize, vsize));
     } catch(std::exception &e){
-        std::cout << "piece too close to square edge" << std::endl;
+        LOG_DEBUG("piece too close to square edge");
         return false;
     }
 
@@ -310,15 +322,50 @@ bool Square::determinePieceColor(cv::Vec3i circle, int& color) const{
 
 std::vector<cv::Point2d> Square::getCornerpointsSorted() const
 {
-    return cornerpointsSorted;
+    Points2d cornerpoints(4);
+    for (size_t i = 0; i < 4; i++){
+        cornerpoints[i] = getCornerpoint(i);
+    }
+    return cornerpoints;
 }
 
-Lines Square::getBordersSorted()
+Lines Square::getBordersSorted() const
 {
+    Lines borders{Line(getCornerpoint(3), getCornerpoint(0)), Line(getCornerpoint(0), getCornerpoint(1)),
+                  Line(getCornerpoint(1), getCornerpoint(2)), Line(getCornerpoint(2), getCornerpoint(3))};
     return borders;
 }
 
-std::vector<int> Square::getSquareTypes(Squares squares)
+std::vector<Corner> Square::getCorners() const
+{
+    std::vector<Corner> corners;
+    getSquareType();
+    if (!(geom.flags & SquareGeom::CORNERS_CREATED))
+        return corners;
+
+    for (size_t i = 0; i < 4; i++){
+        corners.push_back(cornerCache.getCorner(global::image, getCornerpoint(i), geom.radius[i]));
+    }
+    return corners;
+}
+
+SquareState Square::getState() const
+{
+    SquareState state;
+    if (!isOutOfBounds())
+        state.area = getArea();
+    state.borders = getBordersSorted();
+    state.corners = getCorners();
+
+    cv::Point2d p1, p2;
+    state.borders[0].Intersection(state.borders[2], p1);
+    state.borders[1].Intersection(state.borders[3], p2);
+    state.vanishingPoints.push_back(p1);
+    state.vanishingPoints.push_back(p2);
+    return state;
+}
+
+std::vector<int> Square::getSquareTypes(const Squares& squares)
 {
     if (squares.empty()){
         throw std::invalid_argument("vector is empty");
@@ -331,21 +378,15 @@ std::vector<int> Square::getSquareTypes(Squares squares)
     return result;
 }
 
-void Square::createCorners(cv::Mat& image){
+void Square::createCorners() const{
     if (!global::image.data){
         throw std::invalid_argument("global::image is empty, won't create new corner");
     }
-    int radius = 10; // TODO make dynamic
     for (size_t i = 0; i < 4; i++){
-        Corner newcorner(global::image, cornerpointsSorted.at(i), radius);
-        if (newcorner.isOutOfBounds())
-            outOfBounds = true;
-        corners.push_back(newcorner);
-    }
-    if (!outOfBounds){
-        determineType();
+        const Corner& corner = cornerCache.getCorner(global::image, getCornerpoint(i), geom.radius[i]);
+        if (corner.isOutOfBounds())
+            geom.flags |= SquareGeom::OUT_OF_BOUNDS;
+        geom.nRegions[i] = (unsigned char) corner.getNRegions();
     }
+    geom.flags |= SquareGeom::CORNERS_CREATED;
 }
-
-
-
@@ -1,82 +1,105 @@
 #ifndef SQUARE_H
 #define SQUARE_H
 
+#include <atomic>
 #include <opencv2/opencv.hpp>
+#include <type_traits>
 #include <vector>
 
 #include "cvutils.h"
-#include "Line.h"
+#include "line.h"
 #include "typedefs.h"
 #include "corner.h"
+#include "cornercache.h"
 #include "global.h"
 
+// What the detection needs to know about a square. Plain old data, so squares are
+// copied between rows, columns and vectors with a memcpy and never touch the heap.
+struct SquareGeom
+{
+    enum Flags {OUT_OF_BOUNDS = 1, TYPE_DETERMINED = 2, CONTAINS_PIECE = 4, CORNERS_CREATED = 8};
+
+    double x[4], y[4];          // corners sorted upper left, upper right, lower right, lower left
+    double cx, cy;              // center
+    int bx, by, bw, bh;         // bounding box in global::image
+    short meanGray;
+    signed char squareType;     // inner 4, border 3, corner 2, undetermined 0
+    unsigned char nRegions[4];  // number of regions around each corner
+    unsigned char radius[4];    // corner patch radius, follows the local square size
+    unsigned char flags;
+};
+
+static_assert(std::is_pod<SquareGeom>::value, "SquareGeom must stay plain old data");
+
+// Heavyweight diagnostics of a square, only built on request by Square::getState()
+struct SquareState
+{
+    cv::Mat area;
+    Lines borders;              // left, upper, right, lower
+    Corners corners;
+    Points2d vanishingPoints;
+};
 
 class Square
 {
 public:
     // Constructors
-    ~Square(){doesContainPiece = false;}
     Square();
-    Square(cv::Point2d corner1, cv::Point2d corner2, cv::Point2d corner3, cv::Point2d corner4);
+    // cornerRadii are the patch radii of the corners in the order they are given, 0 for the default
+    Square(cv::Point2d corner1, cv::Point2d corner2, cv::Point2d corner3, cv::Point2d corner4, cv::Vec4i cornerRadii = cv::Vec4i());
 
     // Methods
     void draw() const;
     void drawOnImg(cv::Mat& image) const;
 
     // Get and set methods
-    int getMeanGray();
-    size_t getVLength();
-    size_t getHLength();
-    Points2d getCornerpoints();
-    void setCornerpoints(cv::Mat& image, cv::Point2d, cv::Point2d, cv::Point2d, cv::Point2d);
+    int getMeanGray() const {return geom.meanGray;}
+    size_t getVLength() const;
+    size_t getHLength() const;
+    cv::Point2d getCornerpoint(size_t corner) const {return cv::Point2d(geom.x[corner], geom.y[corner]);}
+    int getCornerRadius(size_t corner) const {return geom.radius[corner];}
     std::vector<cv::Point2d> getCornerpointsSorted() const;
-    Lines getBordersSorted();
-    int getSquareType() const {return squareType;}
-    bool isOutOfBounds(){return outOfBounds;}
-    cv::Point2d getCenter(){return center;}
-    Points2d getVanishingPoints(){return vanishingPoints;}
+    Lines getBordersSorted() const;
+    int getSquareType() const; // classifies the square on first call
+    bool isOutOfBounds() const {return (geom.flags & SquareGeom::OUT_OF_BOUNDS) != 0;}
+    cv::Point2d getCenter() const {return cv::Point2d(geom.cx, geom.cy);}
+    cv::Rect getBounds() const {return cv::Rect(geom.bx, geom.by, geom.bw, geom.bh);}
+    const SquareGeom& getGeom() const {return geom;}
 
     // Methods: diagnostics on square
-    void determineType();
+    void determineType() const;
     bool detectPieceWithHough(cv::Vec3i &);
     bool detectPieceWithHough(cv::Mat &image_channel, cv::Vec3i &circle);
     bool determinePieceColor(cv::Vec3i circle, int &color) const;
 
     bool containsPoint(cv::Point2d point) const;
-    std::vector<Corner> getCorners() const {return corners;}
-    bool containsPiece(){return doesContainPiece;}
+    std::vector<Corner> getCorners() const;
+    SquareState getState() const;
+    bool containsPiece() const {return (geom.flags & SquareGeom::CONTAINS_PIECE) != 0;}
 
     // static methoda
-    static std::vector<int> getSquareTypes(Squares);
+    static std::vector<int> getSquareTypes(const Squares&);
+    static CornerCache& getCornerCache(){return cornerCache;}
+
+    // Squares created and squares classified since the last reset
+    static size_t getCreatedCount(){return nCreated;}
+    static size_t getClassifiedCount(){return nClassified;}
+    // Copies are classified without being created, so there can be more classifications than squares
+    static size_t getAvoidedClassifications(){size_t created = nCreated, classified = nClassified; return created > classified ? created - classified : 0;}
+    static void resetCounters(){nCreated = 0; nClassified = 0;}
 
 private:
-    // Variables
-    int meanGray;
-    cv::Mat area;
-    double firstx, firsty, lastx, lasty;
-    std::vector<cv::Point2d> cornerpoints;
-    std::vector<cv::Point2d> cornerpointsSorted;
-    std::vector<Corner> corners;
-    cv::Point2d center;
-    std::vector<Line> borders;
-    Line upperBorder, rightBorder, lowerBorder, leftBorder;
-    cv::Point2d upperLeft, upperRight, lowerRight, lowerLeft;
-    std::vector<cv::Point2d> vanishingPoints;
-    int vlength;
-    int hlength;
-    int squareType;
-    bool squareTypeDetermined;
-    bool outOfBounds;
-    int imsize;
-    int draughtsPiece;
-    bool containsPieceDetermined;
-    bool doesContainPiece;
+    static CornerCache cornerCache;
+    static std::atomic<size_t> nCreated;
+    static std::atomic<size_t> nClassified;
+
+    mutable SquareGeom geom; // corners and type are filled in on first use
 
     // Methods
-    void calcVanishingPoints();
-    void calcBorders();
-    int calcMeanGray(cv::Mat& area);
-    void createCorners(cv::Mat& image);
+    cv::Mat getArea() const;
+    static int calcMeanGray(const cv::Mat& area);
+    void classify() const;
+    void createCorners() const;
 };
 
 #endif // SQUARE_H
@@ -14,10 +14,11 @@ void SquareExpander::calculatePoints()
     leftMid = cvutils::centerpoint(cpoints.at(0), cpoints.at(3));
 }
 
-SquareExpander::SquareExpander(Square square_, Direction dir_)
+SquareExpander::SquareExpander(const Square& square_, Direction dir_)
 {
 
     canExpand = false;
+    outsideImage = false;
     baseSquare = square_;
     dir = dir_;
 
@@ -42,6 +43,8 @@ void SquareExpander::namePoints()
    case UP:
        c1 = cpoints.at(0);
        c2 = cpoints.at(1);
+       r1 = baseSquare.getCornerRadius(0);
+       r2 = baseSquare.getCornerRadius(1);
 
        D = leftMid;
        E = topMid;
@@ -51,6 +54,8 @@ void SquareExpander::namePoints()
    case RIGHT:
        c1 = cpoints.at(1);
        c2 = cpoints.at(2);
+       r1 = baseSquare.getCornerRadius(1);
+       r2 = baseSquare.getCornerRadius(2);
 
        D = topMid;
        E = rightMid;
@@ -60,6 +65,8 @@ void SquareExpander::namePoints()
    case DOWN:
        c1 = cpoints.at(2);
        c2 = cpoints.at(3);
+       r1 = baseSquare.getCornerRadius(2);
+       r2 = baseSquare.getCornerRadius(3);
 
        D = rightMid;
        E = bottomMid;
@@ -69,6 +76,8 @@ void SquareExpander::namePoints()
    case LEFT:
        c1 = cpoints.at(3);
        c2 = cpoints.at(0);
+       r1 = baseSquare.getCornerRadius(3);
+       r2 = baseSquare.getCornerRadius(0);
 
        D = bottomMid;
        E = leftMid;
@@ -143,7 +152,11 @@ void SquareExpander::createSquare()
 {
     if (!canExpand)
         return;
-    Square sq(c1, c2, K, L);
+    if (cvutils::negCoordinate(c1) || cvutils::negCoordinate(c2) || cvutils::negCoordinate(K) || cvutils::negCoordinate(L)){
+        outsideImage = true; // Square would throw, let the caller decide
+        return;
+    }
+    Square sq(c1, c2, K, L, cv::Vec4i(r1, r2, r1, r2)); // K is extrapolated along the border through c1, L through c2
     newSquare = sq;
 }
 
@@ -2,15 +2,16 @@
 #define EXPANDSQUARE_H
 
 #include "square.h"
-#include "Line.h"
+#include "line.h"
 
 
 class SquareExpander
 {
 public:
-    SquareExpander(Square square_, Direction dir_);
+    SquareExpander(const Square& square_, Direction dir_);
     Square getSquare(){return newSquare;}
     bool hasExpanded(){return canExpand;}
+    bool leavesImage() const {return outsideImage;} // the new square would have a negative coordinate
 
 private:
     Square baseSquare;
@@ -18,8 +19,10 @@ private:
     Points2d cpoints;
     Direction dir;
     bool canExpand;
+    bool outsideImage;
     Line b1, b2; // left border, rigth border relative to having base square behind you and looking in direction of expansion
     cv::Point2d c1, c2; // left corner, right corner
+    int r1, r2; // corner patch radii of c1 and c2
     cv::Point2d A, B, C, D, E, F, G, H, I, J, K, L;
     cv::Point2d topMid, rightMid, bottomMid, leftMid;
 
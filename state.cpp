@@ -1,18 +1,19 @@
 #include "state.h"
+#include "log.h"
 
 State::State() : matrix<int>(8,8,0){
     nBlack = nWhite = 0;
 }
 
 void State::print() const{
-    if (elements.empty()){
-        std::cout << "Cannot print empty board" << std::endl;
+    if (empty()){
+        LOG_WARN("Cannot print empty board");
         return;
     }
     std::cout << "-----------------------------------------" << std::endl;
     for (int i = 0; i < 8; i++){
         for (int j = 0; j < 8; j++){
-            std::cout << elements[getIndex(i,j)] << "\t";
+            std::cout << elementAt(getIndex(i,j)) << "\t";
         }
         std::cout << std::endl;
     }
@@ -20,15 +21,13 @@ void State::print() const{
 }
 
 void State::copyTo(State &state) const{
-    state.elements = elements;
-    state.nRows = nRows;
-    state.nCols = nCols;
+    static_cast<matrix<int>&>(state) = *this;
     state.nBlack = nBlack;
     state.nWhite = nWhite;
 }
 
 State::State(const State &oldstate, size_t pieceIdx, std::pair<int, int> move){
-    if (oldstate.elements.size() == 0){
+    if (oldstate.empty()){
         throw std::invalid_argument("input state empty");
     }
 
@@ -36,13 +35,13 @@ State::State(const State &oldstate, size_t pieceIdx, std::pair<int, int> move){
 
     int piece = oldstate.getElement(pieceIdx);
     size_t newidx = pieceIdx + move.first*8 + move.second; // assumes that only legal moves are passed in!! to avoid checking this twice
-    elements[pieceIdx] = 0;
-    elements[newidx] = piece;
+    elementAt(pieceIdx) = 0;
+    elementAt(newidx) = piece;
     if (std::abs(move.first) == 2){ // attack move
         piece > 0 ? nWhite-- : nBlack--;
         std::pair<int,int> pieceCoord = getRowCol(pieceIdx);
         size_t removedPieceIdx = getIndex(pieceCoord.first+move.first/2, pieceCoord.second+move.second/2);
-        elements[removedPieceIdx] = 0;
+        elementAt(removedPieceIdx) = 0;
     }
 
     // check if moved piece should be turned into a king
@@ -53,11 +52,11 @@ State::State(const State &oldstate, size_t pieceIdx, std::pair<int, int> move){
     int nFirstrow = std::count(firstrow.begin(), firstrow.end(), newidx);
 
     if (piece > 0 && nLastrow > 0){
-        elements[newidx] = 2;
+        elementAt(newidx) = 2;
     }
 
     if (piece < 0 && nFirstrow > 0) {
-        elements[newidx] = -2;
+        elementAt(newidx) = -2;
     }
 }
 
@@ -65,7 +64,7 @@ State::State(std::vector<std::pair<size_t, int> > pieces) : State(){
     for (size_t i = 0; i < pieces.size(); i++){
         std::pair<size_t, int> piece = pieces[i];
         size_t idx = piece.first;
-        elements[idx] = piece.second;
+        elementAt(idx) = piece.second;
         piece.second > 0 ? nBlack++ : nWhite++;
     }
 }
@@ -100,35 +99,35 @@ std::vector<int> State::getSurroundings(size_t element) const{
     // Set surroundings: circle around inner loop then outer loop, starting in upper left corner
     valid = getSmartIndex(row-1, col-1, idx);
     if (valid)
-        surroundings[0] = elements[idx];
+        surroundings[0] = elementAt(idx);
 
     valid = getSmartIndex(row-1, col+1, idx);
     if (valid)
-        surroundings[1] = elements[idx];
+        surroundings[1] = elementAt(idx);
 
     valid = getSmartIndex(row+1, col+1, idx);
     if (valid)
-        surroundings[2] = elements[idx];
+        surroundings[2] = elementAt(idx);
 
     valid = getSmartIndex(row+1, col-1, idx);
     if (valid)
-        surroundings[3] = elements[idx];
+        surroundings[3] = elementAt(idx);
 
     valid = getSmartIndex(row-2, col-2, idx);
     if (valid)
-        surroundings[4] = elements[idx];
+        surroundings[4] = elementAt(idx);
 
     valid = getSmartIndex(row-2, col+2, idx);
     if (valid)
-        surroundings[5] = elements[idx];
+        surroundings[5] = elementAt(idx);
 
     valid = getSmartIndex(row+2, col+2, idx);
     if (valid)
-        surroundings[6] = elements[idx];
+        surroundings[6] = elementAt(idx);
 
     valid = getSmartIndex(row+2, col-2, idx);
     if (valid)
-        surroundings[7] = elements[idx];
+        surroundings[7] = elementAt(idx);
 
 
     return surroundings;
@@ -188,7 +187,7 @@ std::vector<State> State::findMovesForPiece(int pieceIdx) const{
             if (surrs[i] == 0){
                 State newstate(*this, pieceIdx, innermoves[i]);
                 moves.push_back(newstate);
-                std::cout << "Adding inner move: " << std::endl;
+                LOG_TRACE("Adding inner move: ");
                 newstate.print();
             }
         }
@@ -3,23 +3,54 @@
 ######################################################################
 
 QT += testlib
+QT -= gui
+CONFIG += c++11 testcase
 TEMPLATE = app
 TARGET = tests
 INCLUDEPATH += /usr/local/include/ \
-              /Users/benedicte/CVGui/
+              ..
 
 LIBS += -L/usr/local/lib \
      -lopencv_core \
      -lopencv_imgproc \
      -lopencv_features2d\
-     -lopencv_highgui
+     -lopencv_highgui \
+     -lopencv_calib3d
 
 
 # Input
 SOURCES += tests.cpp \
         ../cvutils.cpp \
-        ../Chessboard.cpp \
-        ../Line.cpp \
+        ../line.cpp \
+        ../corner.cpp \
+        ../cornerrefiner.cpp \
+        ../cornercache.cpp \
+        ../square.cpp \
+        ../squareExpander.cpp \
+        ../board.cpp \
+        ../boarddetector.cpp \
+        ../remover.cpp \
+        ../regression.cpp \
+        ../report.cpp \
+        ../state.cpp \
+        ../piecedetector.cpp \
+        ../boardrectifier.cpp \
+        ../debugsink.cpp \
+        ../log.cpp
 
-HEADERS  += ../Chessboard.h \
-    ../Line.h
+HEADERS  += ../line.h \
+    ../corner.h \
+    ../cornerrefiner.h \
+    ../cornercache.h \
+    ../square.h \
+    ../board.h \
+    ../boarddetector.h \
+    ../remover.h \
+    ../regression.h \
+    ../report.h \
+    ../state.h \
+    ../squareExpander.h \
+    ../piecedetector.h \
+    ../boardrectifier.h \
+    ../debugsink.h \
+    ../log.h
@@ -7,10 +7,9 @@
 #include <time.h>
 
 namespace utils {
-/*
 
 // Get current date/time, format is YYYY-MM-DD.HH:mm:ss
-const std::string currentDateTime() {
+inline std::string currentDateTime() {
 // REF: http://stackoverflow.com/questions/997946/how-to-get-current-time-and-date-in-c
     time_t     now = time(0);
     struct tm  tstruct;
@@ -22,6 +21,6 @@ const std::string currentDateTime() {
 
     return buf;
 }
-*/
+
 } // end namespace utils
 #endif // UTILS_H